@@ -18,6 +18,11 @@ public:
     virtual bool Load(const string &model_name) { return false; }
 
     virtual bool Train(const Mat &feats, const vector<int> &labels) = 0;
+    // Train again with new rows appended to the last training rows
+    virtual bool Retrain(const Mat &feats, const vector<int> &labels)
+    {
+        return Train(feats, labels);
+    }
     virtual bool Predict(const Mat &feats, vector<int> *labels) const = 0;
     virtual bool Predict(const Mat &feats, vector<int> *labels,
             vector<float> *probs) const { return false; }
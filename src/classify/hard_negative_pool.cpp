@@ -0,0 +1,192 @@
+/*************************************************************************
+    > File Name: hard_negative_pool.cpp
+    > Author: Guo Hengkai
+    > Description: Persistent hard negative pool class implementation
+    > Created Time: Tue 14 Jul 2015 09:40:06 PM CST
+ ************************************************************************/
+#include "hard_negative_pool.h"
+
+namespace ghk
+{
+namespace
+{
+const char HARD_NEG_POOL_MAGIC[8] = {'G', 'H', 'K', 'H', 'N', 'E', 'G', '1'};
+
+// feat_key, model_key, frame, rect, prob and dim before the feature,
+// a record with dim 0 only marks the frame as mined
+struct RecordHead
+{
+    uint64_t feat_key;
+    uint64_t model_key;
+    uint32_t frame;
+    int32_t rect[4];
+    float prob;
+    int32_t dim;
+};
+const size_t RECORD_HEAD_SIZE = 2 * sizeof(uint64_t) + sizeof(uint32_t)
+    + 4 * sizeof(int32_t) + sizeof(float) + sizeof(int32_t);
+
+void ReadHead(const char *data, RecordHead *head)
+{
+    memcpy(&head->feat_key, data, sizeof(head->feat_key));
+    data += sizeof(head->feat_key);
+    memcpy(&head->model_key, data, sizeof(head->model_key));
+    data += sizeof(head->model_key);
+    memcpy(&head->frame, data, sizeof(head->frame));
+    data += sizeof(head->frame);
+    memcpy(head->rect, data, sizeof(head->rect));
+    data += sizeof(head->rect);
+    memcpy(&head->prob, data, sizeof(head->prob));
+    data += sizeof(head->prob);
+    memcpy(&head->dim, data, sizeof(head->dim));
+}
+}  // namespace
+
+HardNegativePool::~HardNegativePool()
+{
+    Close();
+}
+
+bool HardNegativePool::Open(const string &file_name)
+{
+    Close();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The features saved by the earlier runs stay in the mapping
+    bool flag = file_.Open(file_name, HARD_NEG_POOL_MAGIC,
+            sizeof(HARD_NEG_POOL_MAGIC), [&](const char *data, size_t size) {
+        if (size < RECORD_HEAD_SIZE)
+        {
+            return size_t(0);
+        }
+        RecordHead head;
+        ReadHead(data, &head);
+        size_t record_size = RECORD_HEAD_SIZE + head.dim * sizeof(float);
+        if (head.dim < 0 || record_size > size)
+        {
+            return size_t(0);
+        }
+        Add(head.feat_key, HardNegative{head.frame,
+                Rect(head.rect[0], head.rect[1], head.rect[2],
+                    head.rect[3]), head.prob, head.model_key,
+                reinterpret_cast<const float*>(data + RECORD_HEAD_SIZE),
+                head.dim});
+        return record_size;
+    });
+    printf("Hard negative pool: %zu frames from %s\n", frames_.size(),
+            file_name.c_str());
+    return flag;
+}
+
+void HardNegativePool::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.clear();
+    frames_.clear();
+    new_feats_.clear();
+    file_.Close();
+}
+
+void HardNegativePool::GetFeats(uint64_t feat_key, size_t max_num,
+        Mat *feats) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    feats->resize(0);
+    auto iter = samples_.find(feat_key);
+    if (iter == samples_.end() || iter->second.empty())
+    {
+        return;
+    }
+
+    vector<const HardNegative*> samples;
+    for (const auto &sample: iter->second)
+    {
+        samples.push_back(&sample);
+    }
+    size_t num = min(max_num, samples.size());
+    std::partial_sort(samples.begin(), samples.begin() + num, samples.end(),
+            [](const HardNegative *a, const HardNegative *b) {
+        return a->prob > b->prob;
+    });
+
+    int dim = samples[0]->dim;
+    feats->create(static_cast<int>(num), dim, CV_32F);
+    for (size_t i = 0; i < num; ++i)
+    {
+        memcpy(feats->ptr<float>(static_cast<int>(i)), samples[i]->feat,
+                dim * sizeof(float));
+    }
+}
+
+bool HardNegativePool::IsMined(uint64_t feat_key, size_t frame) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_.count(std::make_pair(feat_key,
+                static_cast<uint32_t>(frame))) > 0;
+}
+
+void HardNegativePool::Put(uint64_t feat_key, size_t frame,
+        const vector<HardNegative> &samples)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &sample: samples)
+    {
+        new_feats_.push_back(vector<float>(sample.feat,
+                    sample.feat + sample.dim));
+        HardNegative new_sample = sample;
+        new_sample.frame = static_cast<uint32_t>(frame);
+        new_sample.feat = new_feats_.back().data();
+        Add(feat_key, new_sample);
+        Write(feat_key, new_sample);
+    }
+    if (samples.empty())
+    {
+        HardNegative mark{static_cast<uint32_t>(frame), Rect(), 0, 0,
+            nullptr, 0};
+        Add(feat_key, mark);
+        Write(feat_key, mark);
+    }
+    file_.Flush();
+}
+
+void HardNegativePool::PrintStat() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t sample_num = 0;
+    for (const auto &samples: samples_)
+    {
+        sample_num += samples.second.size();
+    }
+    printf("Hard negative pool: %zu samples from %zu frames, "
+            "%zu feature settings\n", sample_num, frames_.size(),
+            samples_.size());
+}
+
+void HardNegativePool::Add(uint64_t feat_key, const HardNegative &sample)
+{
+    frames_.insert(std::make_pair(feat_key, sample.frame));
+    vector<HardNegative> &samples = samples_[feat_key];
+    if (sample.dim > 0 && (samples.empty() || samples[0].dim == sample.dim))
+    {
+        samples.push_back(sample);
+    }
+}
+
+void HardNegativePool::Write(uint64_t feat_key, const HardNegative &sample)
+{
+    uint32_t frame = sample.frame;
+    int32_t rect[4] = {sample.rect.x, sample.rect.y, sample.rect.width,
+        sample.rect.height};
+    int32_t dim = sample.dim;
+    file_.Write(&feat_key, sizeof(feat_key));
+    file_.Write(&sample.model_key, sizeof(sample.model_key));
+    file_.Write(&frame, sizeof(frame));
+    file_.Write(rect, sizeof(rect));
+    file_.Write(&sample.prob, sizeof(sample.prob));
+    file_.Write(&dim, sizeof(dim));
+    if (dim > 0)
+    {
+        file_.Write(sample.feat, dim * sizeof(float));
+    }
+}
+}  // namespace ghk
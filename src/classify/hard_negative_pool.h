@@ -0,0 +1,64 @@
+/*************************************************************************
+    > File Name: hard_negative_pool.h
+    > Author: Guo Hengkai
+    > Description: Persistent hard negative pool class definition
+    > Created Time: Tue 14 Jul 2015 09:12:40 PM CST
+ ************************************************************************/
+#ifndef FINAL_HARD_NEGATIVE_POOL_H_
+#define FINAL_HARD_NEGATIVE_POOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include "common.h"
+#include "record_file.h"
+
+namespace ghk
+{
+const string HARD_NEG_POOL_NAME = "/hard_neg.pool";  // pool in base_dir
+
+// False positive window mined from a training frame for detection
+struct HardNegative
+{
+    uint32_t frame;
+    Rect rect;
+    float prob;
+    uint64_t model_key;  // model which mined it
+    const float *feat;
+    int dim;
+};
+
+// Hard negatives of all the training runs keyed by the feature
+// parameters. The frames scanned without any hard negative are saved as
+// well, so the later runs only need to mine the new frames.
+class HardNegativePool
+{
+public:
+    HardNegativePool() {}
+    ~HardNegativePool();
+
+    bool Open(const string &file_name);
+    void Close();
+
+    // Features of at most max_num hard negatives with the highest
+    // probabilities
+    void GetFeats(uint64_t feat_key, size_t max_num, Mat *feats) const;
+    bool IsMined(uint64_t feat_key, size_t frame) const;
+    // Save the hard negatives found in the frame, which can be none
+    void Put(uint64_t feat_key, size_t frame,
+            const vector<HardNegative> &samples);
+
+    void PrintStat() const;
+
+private:
+    mutable std::mutex mutex_;
+    RecordFile file_;
+    map<uint64_t, vector<HardNegative>> samples_;
+    set<std::pair<uint64_t, uint32_t>> frames_;
+    vector<vector<float>> new_feats_;
+
+    void Add(uint64_t feat_key, const HardNegative &sample);
+    void Write(uint64_t feat_key, const HardNegative &sample);
+};
+}  // namespace ghk
+
+#endif  // FINAL_HARD_NEGATIVE_POOL_H_
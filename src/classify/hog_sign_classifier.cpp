@@ -5,13 +5,18 @@
     > Created Time: Mon 25 May 2015 03:37:00 PM CST
  ************************************************************************/
 #include "hog_sign_classifier.h"
+#include <atomic>
+#include <mutex>
 #include "dataset.h"
+#include "feature_cache.h"
 #include "hog_extractor.h"
 #include "svm_classifier.h"
 #include "mat_util.h"
+#include "rotate_augmenter.h"
 #include "math_util.h"
 #include "file_util.h"
 #include "test_util.h"
+#include "thread_pool.h"
 #include "timer.h"
 
 namespace ghk
@@ -95,7 +100,8 @@ bool HogSignClassifier::Train(const Dataset &dataset,
     Mat feats;
     printf("Extracting features...\n");
     timer.Start();
-    hog_extractor_.Extract(images, &feats);
+    hog_extractor_.ExtractCached(images, &feats,
+            images.size() - neg_images.size());
     float t1 = timer.Snapshot();
     printf("Time for extraction: %0.3fs\n", t1);
 
@@ -114,29 +120,61 @@ bool HogSignClassifier::Train(const Dataset &dataset,
     EvaluateClassify(labels, predict_labels, CLASS_NUM, false, &rate, &fp);
     printf("Test on training rate before mining: %0.2f%%\n", rate * 100);
 
-    // Mining hard negative sample
-    timer.Start();
-    printf("Mining hard negative samples...\n");
-    Mat neg_feats;
-    if (!MiningHardSample(dataset, neg_num, img_size, &neg_feats))
+    // Seed with the hard negatives mined by the earlier runs
+    size_t train_num = labels.size();
+    float t3 = 0;
+    if (hard_neg_pool_ != nullptr)
     {
-        printf("Fail to retrain SVM.\n");
-        return true;  // Because the original model can be used
+        timer.Start();
+        Mat pool_feats;
+        hard_neg_pool_->GetFeats(GetFeatKey(), neg_num * mining_rounds_,
+                &pool_feats);
+        if (pool_feats.rows > 0 && pool_feats.cols == feats.cols)
+        {
+            printf("Retraining classifier with %d pooled hard negatives...\n",
+                    pool_feats.rows);
+            neg_labels.assign(pool_feats.rows, 0);
+            labels.insert(labels.end(), neg_labels.begin(), neg_labels.end());
+            feats.push_back(pool_feats);
+            classifier_->Retrain(feats, labels);
+            t3 += timer.Snapshot();
+            printf("Time for retrain: %0.3fs\n", t3);
+        }
     }
-    float t3 = timer.Snapshot();
-    printf("Time for mining: %0.3fs\n", t3);
-    neg_labels.resize(neg_feats.rows, 0);
-    labels.insert(labels.end(), neg_labels.begin(), neg_labels.end());
-    feats.push_back(neg_feats);
 
-    // Retrain the classifier
-    printf("Retraining classifier...\n");
-    classifier_->Train(feats, labels);
-    float t4 = timer.Snapshot();
-    printf("Time for retrain: %0.3fs\n", t4 - t3);
-    labels.erase(labels.begin() + labels.size() - neg_feats.rows, labels.end());
+    // Mining hard negative samples with the current model and retrain
+    // from the last solution for several rounds
+    for (int round = 0; round < mining_rounds_; ++round)
+    {
+        timer.Start();
+        printf("Mining hard negative samples (round %d)...\n", round + 1);
+        Mat neg_feats;
+        if (!MiningHardSample(dataset, neg_num, img_size, &neg_feats))
+        {
+            printf("Fail to retrain SVM.\n");
+            break;  // Because the last model can be used
+        }
+        float t4 = timer.Snapshot();
+        printf("Time for mining: %0.3fs\n", t4);
+        if (neg_feats.rows == 0)
+        {
+            break;
+        }
+        neg_labels.assign(neg_feats.rows, 0);
+        labels.insert(labels.end(), neg_labels.begin(), neg_labels.end());
+        feats.push_back(neg_feats);
+
+        // Retrain the classifier
+        printf("Retraining classifier with %d hard negatives...\n",
+                neg_feats.rows);
+        classifier_->Retrain(feats, labels);
+        float t5 = timer.Snapshot();
+        printf("Time for retrain: %0.3fs\n", t5 - t4);
+        t3 += t5;
+    }
+    labels.resize(train_num);
     feats.resize(labels.size());
-    printf("Total time: %0.3fs\n", t4 + t2);
+    printf("Total time: %0.3fs\n", t2 + t3);
 
     // Test on training again
     classifier_->Predict(feats, &predict_labels);
@@ -154,6 +192,7 @@ bool HogSignClassifier::Train(const Dataset &dataset)
     size_t n = dataset.GetClassifyNum(true);
     Size img_size(img_size_, img_size_);
     printf("Preparing training data...\n");
+    vector<RotateJob> jobs;
     for (size_t i = 0; i < n; ++i)
     {
         Mat image;
@@ -163,15 +202,16 @@ bool HogSignClassifier::Train(const Dataset &dataset)
         labels.push_back(dataset.GetClassifyLabel(true, i));
 
         // Augment using rotation
+        size_t src = images.size() - 1;
         for (int j = 0; j < AUGMENT_TIMES; ++j)
         {
-            Mat rot_img = image.clone();
-            RotateImage(rot_img, Random(AUGMENT_ROTATE * 2 + 1)
-                    - AUGMENT_ROTATE);
-            images.push_back(rot_img);
+            jobs.push_back(RotateJob{src, images.size(),
+                    Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE});
+            images.push_back(Mat());
             labels.push_back(labels[labels.size() - 1]);
         }
     }
+    RotateAugmenter::Default().RotateBatch(&images, jobs);
     
     if (!Train(dataset, images, labels))
     {
@@ -205,6 +245,40 @@ bool HogSignClassifier::Test(const Dataset &dataset)
     EvaluateClassify(labels, predict_labels, CLASS_NUM, true, &rate, &fp);
     printf("Test rate: %0.2f%%\n", rate * 100);
 
+    // Check the dense weight bank against libsvm
+    if (use_svm_ && svm_classifier_.has_weight_bank())
+    {
+        Mat feats;
+        hog_extractor_.ExtractCached(images, &feats);
+        Timer timer;
+        vector<int> bank_labels, svm_labels;
+        vector<float> probs;
+        timer.Start();
+        svm_classifier_.Predict(feats, &bank_labels, &probs);
+        float t1 = timer.Snapshot();
+        svm_classifier_.set_use_weight_bank(false);
+        svm_classifier_.Predict(feats, &svm_labels, &probs);
+        float t2 = timer.Snapshot();
+        svm_classifier_.set_use_weight_bank(true);
+
+        int diff_num = 0;
+        for (size_t i = 0; i < svm_labels.size(); ++i)
+        {
+            if (svm_labels[i] != bank_labels[i])
+            {
+                ++diff_num;
+            }
+        }
+        printf("Weight bank: %d/%zu labels differ from libsvm, "
+                "time %0.3fs vs %0.3fs\n", diff_num, svm_labels.size(),
+                t1, t2 - t1);
+        if (diff_num > 0)
+        {
+            printf("Weight bank does not match libsvm.\n");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -228,7 +302,7 @@ bool HogSignClassifier::Predict(const vector<Mat> &images,
     Mat feats;
     printf("Extracting features...\n");
     // timer.Start();
-    hog_extractor_.Extract(images, &feats);
+    hog_extractor_.ExtractCached(images, &feats);
     cout << feats.size() << endl;
     // float t1 = timer.Snapshot();
     // printf("Time for extration: %0.3fs\n", t1);
@@ -244,6 +318,16 @@ bool HogSignClassifier::Predict(const vector<Mat> &images,
     return true;
 }
 
+bool HogSignClassifier::PredictFeats(const Mat &feats,
+        vector<int> *labels, vector<float> *probs) const
+{
+    if (labels == nullptr)
+    {
+        return false;
+    }
+    return classifier_->Predict(feats, labels, probs);
+}
+
 bool HogSignClassifier::FullTest(const Dataset &dataset,
         const string &dir)
 {
@@ -254,6 +338,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
     Size image_size(img_size_, img_size_);
     printf("Preparing training data...\n");
     Mat rotate_angle(n, AUGMENT_TIMES, CV_32F);
+    vector<RotateJob> jobs;
     for (size_t i = 0; i < n; ++i)
     {
         Mat image;
@@ -263,16 +348,17 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
         labels.push_back(dataset.GetClassifyLabel(true, i));
 
         // Augment using rotation
+        size_t src = images.size() - 1;
         for (int j = 0; j < AUGMENT_TIMES; ++j)
         {
-            Mat rot_img = image.clone();
-            rotate_angle.at<float>(i, j) = 
-                Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE;
-            RotateImage(rot_img, rotate_angle.at<float>(i, j));
-            images.push_back(rot_img);
+            int angle = Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE;
+            rotate_angle.at<float>(i, j) = angle;
+            jobs.push_back(RotateJob{src, images.size(), angle});
+            images.push_back(Mat());
             labels.push_back(labels[labels.size() - 1]);
         }
     }
+    RotateAugmenter::Default().RotateBatch(&images, jobs);
 
     // Find random negative sample
     vector<Mat> neg_images;
@@ -309,6 +395,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
         vector<Mat> size_test_img;
         vector<Mat> size_neg_img;
         Size img_size(size, size);
+        jobs.clear();
         for (size_t i = 0; i < n; ++i)
         {
             Mat image;
@@ -317,13 +404,16 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
             size_train_img.push_back(image);
 
             // Augment using rotation
+            size_t src = size_train_img.size() - 1;
             for (int j = 0; j < AUGMENT_TIMES; ++j)
             {
-                Mat rot_img = image.clone();
-                RotateImage(rot_img, rotate_angle.at<float>(i, j));
-                size_train_img.push_back(rot_img);
+                jobs.push_back(RotateJob{src, size_train_img.size(),
+                        static_cast<int>(rotate_angle.at<float>(i, j))});
+                size_train_img.push_back(Mat());
             }
         }
+        RotateAugmenter::Default().RotateBatch(&size_train_img, jobs);
+        size_t pos_img_num = size_train_img.size();
         for (size_t i = 0; i < test_n; ++i)
         {
             Mat image;
@@ -354,7 +444,8 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
 
                 Mat feats;
                 hog_extractor_.set_cell_size(cell_size);
-                hog_extractor_.Extract(size_train_img, &feats);
+                hog_extractor_.ExtractCached(size_train_img, &feats,
+                        pos_img_num);
                 svm_classifier_.Train(feats, labels);
                 labels.erase(labels.begin() + labels.size()
                         - neg_images.size(), labels.end());
@@ -377,7 +468,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
                 EvaluateClassify(labels, predict_labels, CLASS_NUM, true,
                         &result_row.at<float>(0, 0),
                         &result_row.at<float>(0, 1));
-                hog_extractor_.Extract(size_test_img, &feats);
+                hog_extractor_.ExtractCached(size_test_img, &feats);
                 svm_classifier_.Predict(feats, &predict_labels);
                 EvaluateClassify(test_labels, predict_labels, CLASS_NUM, true,
                         &result_row.at<float>(0, 2),
@@ -393,9 +484,10 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
     // Test for different penalty coefficients for SVM
     Mat svm_result_penal;
     printf("Training for different penalty coefficients...\n");
+    size_t pos_img_num = images.size();
     images.insert(images.end(), neg_images.begin(), neg_images.end());
     Mat ori_feats;
-    hog_extractor_.Extract(images, &ori_feats);
+    hog_extractor_.ExtractCached(images, &ori_feats, pos_img_num);
     for (float c = 0.0001; c < 1000000; c *= 10)
     {
         printf("%f, ", c);
@@ -426,7 +518,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
         EvaluateClassify(labels, predict_labels, CLASS_NUM, true,
                 &result_row.at<float>(0, 0),
                 &result_row.at<float>(0, 1));
-        hog_extractor_.Extract(test_images, &feats);
+        hog_extractor_.ExtractCached(test_images, &feats);
         svm_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(test_labels, predict_labels, CLASS_NUM, true,
                 &result_row.at<float>(0, 2),
@@ -446,7 +538,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
     labels.insert(labels.end(), neg_labels.begin(), neg_labels.end());
 
     Mat feats;
-    hog_extractor_.Extract(images, &feats);
+    hog_extractor_.ExtractCached(images, &feats, pos_img_num);
     svm_classifier_.Train(feats, labels);
     labels.erase(labels.begin() + labels.size()
             - neg_images.size(), labels.end());
@@ -463,7 +555,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
             &best_result_before_train[1],
             &mat_before_train);
     Mat test_feats;
-    hog_extractor_.Extract(test_images, &test_feats);
+    hog_extractor_.ExtractCached(test_images, &test_feats);
     svm_classifier_.Predict(test_feats, &predict_labels);
     EvaluateClassify(test_labels, predict_labels, CLASS_NUM, true,
             &best_result_before_test[0],
@@ -493,7 +585,7 @@ bool HogSignClassifier::FullTest(const Dataset &dataset,
             &best_result_after_train[0],
             &best_result_after_train[1],
             &mat_after_train);
-    hog_extractor_.Extract(test_images, &feats);
+    hog_extractor_.ExtractCached(test_images, &feats);
     svm_classifier_.Predict(feats, &predict_labels);
     EvaluateClassify(test_labels, predict_labels, CLASS_NUM, true,
             &best_result_after_test[0],
@@ -520,29 +612,55 @@ bool HogSignClassifier::MiningHardSample(const Dataset &dataset,
         return false;
     }
 
+    uint64_t feat_key = GetFeatKey();
+    uint64_t model_key = GetModelKey();
     vector<size_t> image_idxs;
     for (size_t i = 0; i < dataset.GetDetectNum(true); ++i)
     {
-        image_idxs.push_back(i);
+        if (hard_neg_pool_ == nullptr || !hard_neg_pool_->IsMined(feat_key, i))
+        {
+            image_idxs.push_back(i);
+        }
     }
     std::random_shuffle(image_idxs.begin(), image_idxs.end());
+    image_idxs.resize(min(image_idxs.size(), mining_frame_num_));
 
-    neg_feats->resize(0);
-    const int step = 10;
-    for (auto idx: image_idxs)
+    // The false positives with the highest probabilities are kept in a
+    // min-heap of all the frames
+    struct HardSample
     {
+        float prob;
+        Mat feat;
+    };
+    auto greater_prob = [](const HardSample &a, const HardSample &b) {
+        return a.prob > b.prob;
+    };
+    vector<HardSample> heap;
+    std::mutex heap_mutex;
+    std::atomic<bool> success(true);
+
+    // Each frame is mined by one thread, and its windows are featurized
+    // and scored in batches
+    const int step = 10;
+    ThreadPool::Default().ParallelFor(image_idxs.size(),
+            [&](size_t i, int thread_id) {
+        size_t idx = image_idxs[i];
         Mat full_image;
-        if (!dataset.GetDetectImage(true, idx, &full_image))
+        if (!success || !dataset.GetDetectImage(true, idx, &full_image))
         {
-            continue;
+            return;
         }
-        
+        cv::cvtColor(full_image, full_image, CV_BGR2GRAY);
+
+        vector<Rect> rects;
         for (int x = 0; x < full_image.cols; x += step * 2)
             for (int y = 0; y < full_image.rows; y += step * 2)
-                for (size_t size_idx = 0; size_idx < SIZE_LIST.size(); ++size_idx)
+                for (size_t size_idx = 0; size_idx < SIZE_LIST.size();
+                        ++size_idx)
                 {
                     int size = SIZE_LIST[size_idx];
-                    if (x + size >= full_image.cols || y + size >= full_image.rows)
+                    if (x + size >= full_image.cols
+                            || y + size >= full_image.rows)
                     {
                         break;
                     }
@@ -550,59 +668,106 @@ bool HogSignClassifier::MiningHardSample(const Dataset &dataset,
                     Rect rect(x, y, size, size);
                     if (dataset.IsNegativeImage(true, idx, rect))
                     {
-                        Mat image = full_image(rect).clone();
-                        cv::resize(image, image, image_size);
-                        cv::cvtColor(image, image, CV_BGR2GRAY);
-                       
-                        /*
-                        vector<Mat> image_vec(AUGMENT_TIMES + 1, image);
-                        for (int i = 0; i < AUGMENT_TIMES; ++i)
-                        {
-                            RotateImage(image_vec[i + 1],
-                                    Random(AUGMENT_ROTATE * 2 + 1)
-                                    - AUGMENT_ROTATE);
-                        }
-                        */
-                        vector<Mat> image_vec(1, image);
-
-                        Mat feat_row;
-                        if (!hog_extractor_.Extract(image_vec, &feat_row))
-                        {
-                            return false;
-                        }
-
-                        // False positive
-                        vector<int> labels;
-                        vector<float> probs;
-                        if (!classifier_->Predict(feat_row, &labels, &probs))
-                        {
-                            return false;
-                        }
-
-                        /*
-                        for (size_t i = 0; i < labels.size(); ++i)
-                        {
-                            if (labels[i] != 0)
-                            {
-                                neg_feats->push_back(feat_row.row(i));
-                                if (neg_feats->rows >= static_cast<int>(neg_num))
-                                {
-                                    return true;
-                                }
-                            }
-                        }*/
-                        if (labels[0] != 0 && probs[0] >= 0.9)
-                        {
-                            neg_feats->push_back(feat_row);
-                            if (neg_feats->rows >= static_cast<int>(neg_num))
-                            {
-                                return true;
-                            }
-                        }
+                        rects.push_back(rect);
                     }
                 }
 
+        vector<Mat> images;
+        Mat feats;
+        vector<int> labels;
+        vector<float> probs;
+        vector<HardNegative> pool_samples;
+        Mat pool_feats;
+        for (size_t begin = 0; begin < rects.size();
+                begin += MINING_BATCH_SIZE)
+        {
+            size_t end = min(rects.size(), begin + MINING_BATCH_SIZE);
+            images.resize(end - begin);
+            for (size_t j = begin; j < end; ++j)
+            {
+                cv::resize(full_image(rects[j]), images[j - begin],
+                        image_size);
+            }
+            if (!hog_extractor_.ExtractBatch(images, &feats)
+                    || !classifier_->Predict(feats, &labels, &probs))
+            {
+                success = false;
+                return;
+            }
+
+            for (int j = 0; j < feats.rows; ++j)
+            {
+                if (hard_neg_pool_ != nullptr && labels[j] != 0
+                        && probs[j] >= MINING_MIN_PROB)
+                {
+                    pool_samples.push_back(HardNegative{
+                            static_cast<uint32_t>(idx), rects[begin + j],
+                            probs[j], model_key, nullptr, feats.cols});
+                    pool_feats.push_back(feats.row(j));
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(heap_mutex);
+            for (int j = 0; j < feats.rows; ++j)
+            {
+                if (labels[j] == 0 || probs[j] < MINING_MIN_PROB
+                        || (heap.size() >= neg_num
+                            && probs[j] <= heap.front().prob))
+                {
+                    continue;
+                }
+                if (heap.size() >= neg_num)
+                {
+                    std::pop_heap(heap.begin(), heap.end(), greater_prob);
+                    heap.pop_back();
+                }
+                heap.push_back(HardSample{probs[j], feats.row(j).clone()});
+                std::push_heap(heap.begin(), heap.end(), greater_prob);
+            }
+        }
+
+        // All the false positives of the frame are pooled for later runs
+        if (hard_neg_pool_ != nullptr)
+        {
+            for (size_t j = 0; j < pool_samples.size(); ++j)
+            {
+                pool_samples[j].feat =
+                    pool_feats.ptr<float>(static_cast<int>(j));
+            }
+            hard_neg_pool_->Put(feat_key, idx, pool_samples);
+        }
+    });
+    if (!success)
+    {
+        return false;
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), greater_prob);
+    neg_feats->resize(0);
+    for (const auto &sample: heap)
+    {
+        neg_feats->push_back(sample.feat);
     }
     return true;
 }
+
+uint64_t HogSignClassifier::GetFeatKey() const
+{
+    return HashBytes(&img_size_, sizeof(img_size_),
+            hog_extractor_.GetParamKey());
+}
+
+uint64_t HogSignClassifier::GetModelKey() const
+{
+    uint64_t key = HashBytes(&use_svm_, sizeof(use_svm_));
+    Mat weights, bias;
+    vector<int> labels;
+    if (use_svm_ && svm_classifier_.GetLinearWeights(&weights, &bias,
+                &labels))
+    {
+        key = HashImage(weights, key);
+        key = HashImage(bias, key);
+    }
+    return key;
+}
 }  // namespace ghk
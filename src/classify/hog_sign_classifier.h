@@ -12,11 +12,17 @@
 #include "classifier.h"
 #include "hog_extractor.h"
 #include "forest_classifier.h"
+#include "hard_negative_pool.h"
 #include "svm_classifier.h"
 #include "sign_classifier.h"
 
 namespace ghk
 {
+const int MINING_ROUNDS = 3;  // rounds of hard negative mining
+const size_t MINING_FRAME_NUM = 300;  // frames scanned in each round
+const size_t MINING_BATCH_SIZE = 256;  // windows scored together
+const float MINING_MIN_PROB = 0.9f;  // for a false positive to be mined
+
 class HogSignClassifier: public SignClassifier
 {
 public:
@@ -24,7 +30,8 @@ public:
             float c = 125, int img_size = 100, bool use_svm = true):
         hog_extractor_(num_orient, cell_size),
         svm_classifier_(c), forest_classifier_(13, 10, 200),
-        img_size_(img_size)
+        img_size_(img_size), mining_rounds_(MINING_ROUNDS),
+        mining_frame_num_(MINING_FRAME_NUM), hard_neg_pool_(nullptr)
     {
         use_svm_ = !use_svm;  // Force to update the pointer
         set_use_svm(use_svm);
@@ -41,8 +48,34 @@ public:
             const string &dir);
     virtual bool Predict(const vector<Mat> &images,
             vector<int> *labels);
+    virtual void SetFeatureCache(FeatureCache *cache)
+    {
+        hog_extractor_.set_feature_cache(cache);
+    }
     bool Predict(const vector<Mat> &images,
             vector<int> *labels, vector<float> *probs);
+    // Predict on HOG features which are already extracted
+    bool PredictFeats(const Mat &feats, vector<int> *labels,
+            vector<float> *probs) const;
+
+    inline const HogExtractor& hog_extractor() const
+    {
+        return hog_extractor_;
+    }
+    inline int img_size() const { return img_size_; }
+    inline void set_mining_rounds(int mining_rounds)
+    {
+        mining_rounds_ = mining_rounds;
+    }
+    inline void set_mining_frame_num(size_t mining_frame_num)
+    {
+        mining_frame_num_ = mining_frame_num;
+    }
+    // Seed the mining from the pool and save the new hard negatives
+    inline void set_hard_neg_pool(HardNegativePool *hard_neg_pool)
+    {
+        hard_neg_pool_ = hard_neg_pool;
+    }
 
     inline void set_use_svm(bool use_svm)
     {
@@ -68,9 +101,19 @@ private:
     bool use_svm_;
 
     int img_size_;
+    int mining_rounds_;
+    size_t mining_frame_num_;
+    HardNegativePool *hard_neg_pool_;
 
+    // Mine the false positives with the highest probabilities from the
+    // negative windows of at most mining_frame_num_ training frames,
+    // the frames in the pool are skipped
     bool MiningHardSample(const Dataset &dataset,
             size_t neg_num, Size image_size, Mat *neg_feats);
+    // Key of the HOG parameters and image size for the pooled features
+    uint64_t GetFeatKey() const;
+    // Key of the current model for the provenance of the hard negatives
+    uint64_t GetModelKey() const;
 };
 }  // namespace ghk
 
@@ -11,6 +11,7 @@
 #include "fisher_extractor.h"
 #include "knn_classifier.h"
 #include "mat_util.h"
+#include "rotate_augmenter.h"
 #include "math_util.h"
 #include "file_util.h"
 #include "test_util.h"
@@ -104,6 +105,7 @@ bool KnnSignClassifier::Train(const Dataset &dataset)
     size_t n = dataset.GetClassifyNum(true);
     Size img_size(img_size_, img_size_);
     printf("Preparing training data...\n");
+    vector<RotateJob> jobs;
     for (size_t i = 0; i < n; ++i)
     {
         Mat image;
@@ -113,15 +115,16 @@ bool KnnSignClassifier::Train(const Dataset &dataset)
         labels.push_back(dataset.GetClassifyLabel(true, i));
 
         // Augment using rotation
+        size_t src = images.size() - 1;
         for (int j = 0; j < AUGMENT_TIMES; ++j)
         {
-            Mat rot_img = image.clone();
-            RotateImage(rot_img, Random(AUGMENT_ROTATE * 2 + 1)
-                    - AUGMENT_ROTATE);
-            images.push_back(rot_img);
+            jobs.push_back(RotateJob{src, images.size(),
+                    Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE});
+            images.push_back(Mat());
             labels.push_back(labels[labels.size() - 1]);
         }
     }
+    RotateAugmenter::Default().RotateBatch(&images, jobs);
     if (!use_threshold_)
     {
         // Find negative sample
@@ -150,7 +153,8 @@ bool KnnSignClassifier::Train(const Dataset &dataset)
     // Feature extraction
     Mat feats;
     printf("Extracting features...\n");
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats,
+            images.size() - neg_images.size());
     float t2 = timer.Snapshot();
     printf("Time for extraction: %0.3fs\n", t2 - t1);
 
@@ -228,7 +232,7 @@ bool KnnSignClassifier::Predict(const vector<Mat> &images,
     Mat feats;
     printf("Extracting features...\n");
     timer.Start();
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     float t1 = timer.Snapshot();
     printf("Time for extraction: %0.3fs\n", t1);
 
@@ -270,6 +274,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     Size img_size(img_size_, img_size_);
     printf("Preparing training data...\n");
     Mat rotate_angle(n, AUGMENT_TIMES, CV_32F);
+    vector<RotateJob> jobs;
     for (size_t i = 0; i < n; ++i)
     {
         Mat image;
@@ -279,16 +284,17 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
         labels.push_back(dataset.GetClassifyLabel(true, i));
 
         // Augment using rotation
+        size_t src = images.size() - 1;
         for (int j = 0; j < AUGMENT_TIMES; ++j)
         {
-            Mat rot_img = image.clone();
-            rotate_angle.at<float>(i, j) = 
-                Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE;
-            RotateImage(rot_img, rotate_angle.at<float>(i, j));
-            images.push_back(rot_img);
+            int angle = Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE;
+            rotate_angle.at<float>(i, j) = angle;
+            jobs.push_back(RotateJob{src, images.size(), angle});
+            images.push_back(Mat());
             labels.push_back(labels[labels.size() - 1]);
         }
     }
+    RotateAugmenter::Default().RotateBatch(&images, jobs);
 
     // Find negative sample
     srand(time(NULL));
@@ -328,7 +334,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
 
         Mat feats;
         extractor_->set_feat_dim(i);
-        extractor_->Extract(images, &feats);
+        extractor_->ExtractCached(images, &feats);
         knn_classifier_.Train(feats, labels);
 
         Mat result_row(1, 4, CV_32F);
@@ -336,7 +342,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 0), &result_row.at<float>(0, 1));
-        extractor_->Extract(test_images, &feats);
+        extractor_->ExtractCached(test_images, &feats);
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(test_labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 2), &result_row.at<float>(0, 3));
@@ -351,9 +357,9 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     printf("Training for different neighbour number with eigen...\n");
     extractor_->Train(images, labels);
     Mat feats;
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     Mat test_feats;
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
     Mat nearest_result_eigen(0, 4, CV_32F);
     for (int i = 1; i < 102; i += 2)
     {
@@ -381,8 +387,8 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     set_use_fisher(true);
     printf("Training for different neighbour number with fisher...\n");
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(images, &feats);
+    extractor_->ExtractCached(test_images, &test_feats);
     Mat nearest_result_fisher(0, 4, CV_32F);
     for (int i = 1; i < 102; i += 2)
     {
@@ -420,6 +426,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
         size_test_img.clear();
         Size img_size(size, size);
 
+        jobs.clear();
         for (size_t i = 0; i < n; ++i)
         {
             Mat image;
@@ -428,13 +435,15 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
             size_train_img.push_back(image);
 
             // Augment using rotation
+            size_t src = size_train_img.size() - 1;
             for (int j = 0; j < AUGMENT_TIMES; ++j)
             {
-                Mat rot_img = image.clone();
-                RotateImage(rot_img, rotate_angle.at<float>(i, j));
-                size_train_img.push_back(rot_img);
+                jobs.push_back(RotateJob{src, size_train_img.size(),
+                        static_cast<int>(rotate_angle.at<float>(i, j))});
+                size_train_img.push_back(Mat());
             }
         }
+        RotateAugmenter::Default().RotateBatch(&size_train_img, jobs);
         for (size_t i = 0; i < test_n; ++i)
         {
             Mat image;
@@ -449,13 +458,13 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
 
         set_use_fisher(false);
         extractor_->Train(size_train_img, labels);
-        extractor_->Extract(size_train_img, &feats);
+        extractor_->ExtractCached(size_train_img, &feats);
         knn_classifier_.Train(feats, labels);
 
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 0), &result_row.at<float>(0, 1));
-        extractor_->Extract(size_test_img, &feats);
+        extractor_->ExtractCached(size_test_img, &feats);
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(test_labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 2), &result_row.at<float>(0, 3));
@@ -463,13 +472,13 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
 
         set_use_fisher(true);
         extractor_->Train(size_train_img, labels);
-        extractor_->Extract(size_train_img, &feats);
+        extractor_->ExtractCached(size_train_img, &feats);
         knn_classifier_.Train(feats, labels);
 
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 0), &result_row.at<float>(0, 1));
-        extractor_->Extract(size_test_img, &feats);
+        extractor_->ExtractCached(size_test_img, &feats);
         knn_classifier_.Predict(feats, &predict_labels);
         EvaluateClassify(test_labels, predict_labels, CLASS_NUM, false,
                 &result_row.at<float>(0, 2), &result_row.at<float>(0, 3));
@@ -485,7 +494,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     printf("Training for different threshold with eigen...\n");
     set_use_fisher(false);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     knn_classifier_.Train(feats, labels);
 
     Mat neg_feats;
@@ -502,7 +511,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     mean /= neg_distance.size();
     deviation = sqrt(deviation / neg_distance.size() - mean * mean);
 
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
 
     Mat result_row(1, 4, CV_32F);
     vector<int> predict_labels;
@@ -562,7 +571,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     printf("Training for different threshold with fisher...\n");
     set_use_fisher(true);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     knn_classifier_.Train(feats, labels);
 
     extractor_->Extract(neg_images, &neg_feats);
@@ -577,7 +586,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     mean /= neg_distance.size();
     deviation = sqrt(deviation / neg_distance.size() - mean * mean);
 
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
 
     knn_classifier_.Predict(feats, &predict_labels, &train_dis);
     EvaluateClassify(labels, predict_labels, CLASS_NUM, true,
@@ -628,16 +637,17 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     SaveMat(dir + "/th_result_fisher", th_result_fisher);
 
     // Test of open-set methods for eigen feature using negative class
+    size_t pos_img_num = images.size();
     images.insert(images.end(), neg_images.begin(), neg_images.end());
     labels.insert(labels.end(), neg_labels.begin(), neg_labels.end());
     printf("Training for negative class with eigen...\n");
     set_use_fisher(false);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats, pos_img_num);
     knn_classifier_.Train(feats, labels);
     labels.erase(labels.begin() + neg_images.size(), labels.end());
     feats.resize(labels.size());
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
 
     Mat neg_result_eigen(1, 4, CV_32F);
     knn_classifier_.Predict(feats, &predict_labels);
@@ -657,11 +667,11 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     printf("Training for negative class with fisher...\n");
     set_use_fisher(true);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats, pos_img_num);
     knn_classifier_.Train(feats, labels);
     labels.erase(labels.begin() + neg_images.size(), labels.end());
     feats.resize(labels.size());
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
 
     Mat neg_result_fisher(1, 4, CV_32F);
     knn_classifier_.Predict(feats, &predict_labels);
@@ -689,7 +699,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     set_use_fisher(false);
     knn_classifier_.set_near_num(5);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     knn_classifier_.Train(feats, labels);
 
     extractor_->Extract(neg_images, &neg_feats);
@@ -707,7 +717,7 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     float t1 = timer.Snapshot();
     printf("Time for training PCA: %0.3fs\n", t1);
 
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
     knn_classifier_.Predict(feats, &predict_labels, &train_dis);
     for (size_t i = 0; i < train_dis.size(); ++i)
     {
@@ -750,9 +760,9 @@ bool KnnSignClassifier::FullTest(const Dataset &dataset, const string &dir)
     set_use_fisher(true);
     knn_classifier_.set_near_num(7);
     extractor_->Train(images, labels);
-    extractor_->Extract(images, &feats);
+    extractor_->ExtractCached(images, &feats);
     knn_classifier_.Train(feats, labels);
-    extractor_->Extract(test_images, &test_feats);
+    extractor_->ExtractCached(test_images, &test_feats);
 
     extractor_->Extract(neg_images, &neg_feats);
     knn_classifier_.Predict(neg_feats, &neg_train_labels, &neg_distance);
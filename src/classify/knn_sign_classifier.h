@@ -33,6 +33,11 @@ public:
             vector<int> *labels);
 
     virtual bool FullTest(const Dataset &dataset, const string &dir);
+    virtual void SetFeatureCache(FeatureCache *cache)
+    {
+        eigen_extractor_.set_feature_cache(cache);
+        fisher_extractor_.set_feature_cache(cache);
+    }
     void set_use_fisher(bool use_fisher);
 
 private:
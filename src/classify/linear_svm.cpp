@@ -0,0 +1,475 @@
+/*************************************************************************
+    > File Name: linear_svm.cpp
+    > Author: Guo Hengkai
+    > Description: Linear SVM trainer function implementation
+    > Created Time: Sun 12 Jul 2015 10:41:05 AM CST
+ ************************************************************************/
+#include "linear_svm.h"
+#include <cmath>
+#include <random>
+#include "thread_pool.h"
+
+namespace ghk
+{
+namespace
+{
+// Solve the dual of min 0.5 * |w|^2 + c * sum(max(0, 1 - y * (w * x + b)))
+// with shrinking as liblinear does, w has the bias b as the last element.
+// The dual variables of the leading rows are given in alpha for warm
+// start, and only the free ones and the new rows are active at first.
+void SolveDcd(const Mat &feats, const vector<int> &rows,
+        const vector<int> &y, double c, uint32_t seed,
+        vector<double> *alpha, vector<double> *w)
+{
+    int dim = feats.cols;
+    int l = static_cast<int>(rows.size());
+    int warm_num = min(static_cast<int>(alpha->size()), l);
+    alpha->resize(l, 0);
+    w->assign(dim + 1, 0);
+    double *wp = w->data();
+    double *ap = alpha->data();
+    vector<double> qd(l);
+    vector<int> index;
+    index.reserve(l);
+    for (int i = 0; i < l; ++i)
+    {
+        const float *x = feats.ptr<float>(rows[i]);
+        double q = 1;  // bias
+        for (int d = 0; d < dim; ++d)
+        {
+            q += static_cast<double>(x[d]) * x[d];
+        }
+        qd[i] = q;
+
+        ap[i] = min(ap[i], c);
+        if (ap[i] != 0)
+        {
+            double coef = ap[i] * y[i];
+            for (int d = 0; d < dim; ++d)
+            {
+                wp[d] += coef * x[d];
+            }
+            wp[dim] += coef;
+        }
+        if (i >= warm_num || (ap[i] > 0 && ap[i] < c))
+        {
+            index.push_back(i);
+        }
+    }
+    int active_size = static_cast<int>(index.size());
+    for (int i = 0; i < warm_num; ++i)
+    {
+        if (ap[i] == 0 || ap[i] == c)
+        {
+            index.push_back(i);
+        }
+    }
+
+    std::mt19937 rng(seed);
+    double pg_max_old = HUGE_VAL;
+    double pg_min_old = -HUGE_VAL;
+    for (int iter = 0; iter < LINEAR_SVM_MAX_ITER; ++iter)
+    {
+        double pg_max_new = -HUGE_VAL;
+        double pg_min_new = HUGE_VAL;
+        std::shuffle(index.begin(), index.begin() + active_size, rng);
+        for (int s = 0; s < active_size; ++s)
+        {
+            int i = index[s];
+            const float *x = feats.ptr<float>(rows[i]);
+            double g = wp[dim];
+            for (int d = 0; d < dim; ++d)
+            {
+                g += wp[d] * x[d];
+            }
+            g = g * y[i] - 1;
+
+            // Projected gradient, and shrink the bounded ones which are
+            // unlikely to move
+            double pg = 0;
+            if (ap[i] == 0)
+            {
+                if (g > pg_max_old)
+                {
+                    std::swap(index[s--], index[--active_size]);
+                    continue;
+                }
+                pg = min(g, 0.0);
+            }
+            else if (ap[i] == c)
+            {
+                if (g < pg_min_old)
+                {
+                    std::swap(index[s--], index[--active_size]);
+                    continue;
+                }
+                pg = max(g, 0.0);
+            }
+            else
+            {
+                pg = g;
+            }
+            pg_max_new = max(pg_max_new, pg);
+            pg_min_new = min(pg_min_new, pg);
+
+            if (fabs(pg) > 1e-12)
+            {
+                double old_alpha = ap[i];
+                ap[i] = min(max(old_alpha - g / qd[i], 0.0), c);
+                double delta = (ap[i] - old_alpha) * y[i];
+                for (int d = 0; d < dim; ++d)
+                {
+                    wp[d] += delta * x[d];
+                }
+                wp[dim] += delta;
+            }
+        }
+
+        if (pg_max_new - pg_min_new <= LINEAR_SVM_EPS)
+        {
+            if (active_size == l)
+            {
+                break;
+            }
+            // Check all the variables again before stopping
+            active_size = l;
+            pg_max_old = HUGE_VAL;
+            pg_min_old = -HUGE_VAL;
+            continue;
+        }
+        pg_max_old = pg_max_new > 0 ? pg_max_new : HUGE_VAL;
+        pg_min_old = pg_min_new < 0 ? pg_min_new : -HUGE_VAL;
+    }
+}
+
+double GetDecision(const vector<double> &w, const float *x)
+{
+    int dim = static_cast<int>(w.size()) - 1;
+    double dec = w[dim];
+    for (int d = 0; d < dim; ++d)
+    {
+        dec += w[d] * x[d];
+    }
+    return dec;
+}
+
+// Pairwise decision functions trained without each fold and with all
+// the rows (the last one), positive for the first class of the pair.
+// All the binary problems of all the folds run in parallel, and the
+// dual variables of each problem are kept in alpha for warm start.
+void TrainFolds(const Mat &feats, const vector<int> &cls, int nr_class,
+        const vector<int> &fold, double c, LinearSvmType type,
+        vector<vector<double>> *alpha,
+        vector<vector<vector<double>>> *fold_w)
+{
+    vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < nr_class; ++i)
+        for (int j = i + 1; j < nr_class; ++j)
+        {
+            pairs.push_back(std::make_pair(i, j));
+        }
+    int n = static_cast<int>(cls.size());
+    int fold_num = LINEAR_SVM_PROB_FOLD + 1;
+    int problem_num = type == LINEAR_SVM_OVO
+        ? static_cast<int>(pairs.size()) : nr_class;
+
+    vector<vector<double>> problem_w(fold_num * problem_num);
+    alpha->resize(problem_w.size());
+    ThreadPool::Default().ParallelFor(problem_w.size(),
+            [&](size_t t, int thread_id) {
+        int f = static_cast<int>(t) / problem_num;
+        int k = static_cast<int>(t) % problem_num;
+        vector<int> rows;
+        vector<int> y;
+        for (int r = 0; r < n; ++r)
+        {
+            if (fold[r] == f)
+            {
+                continue;
+            }
+            if (type == LINEAR_SVM_OVR)
+            {
+                rows.push_back(r);
+                y.push_back(cls[r] == k ? 1 : -1);
+            }
+            else if (cls[r] == pairs[k].first || cls[r] == pairs[k].second)
+            {
+                rows.push_back(r);
+                y.push_back(cls[r] == pairs[k].first ? 1 : -1);
+            }
+        }
+        SolveDcd(feats, rows, y, c, t + 1, &(*alpha)[t], &problem_w[t]);
+    });
+
+    fold_w->assign(fold_num, vector<vector<double>>(pairs.size()));
+    for (int f = 0; f < fold_num; ++f)
+        for (size_t p = 0; p < pairs.size(); ++p)
+        {
+            vector<double> &w = (*fold_w)[f][p];
+            if (type == LINEAR_SVM_OVO)
+            {
+                w.swap(problem_w[f * problem_num + p]);
+                continue;
+            }
+
+            // f_i - f_j of the one-vs-rest functions votes for the argmax
+            const vector<double> &wi =
+                problem_w[f * problem_num + pairs[p].first];
+            const vector<double> &wj =
+                problem_w[f * problem_num + pairs[p].second];
+            w.resize(wi.size());
+            for (size_t d = 0; d < w.size(); ++d)
+            {
+                w[d] = wi[d] - wj[d];
+            }
+        }
+}
+
+// Platt scaling with the Newton method, same as sigmoid_train in libsvm
+void SigmoidTrain(const vector<double> &dec, const vector<int> &y,
+        double *A, double *B)
+{
+    const int max_iter = 100;
+    const double min_step = 1e-10;
+    const double sigma = 1e-12;
+    const double eps = 1e-5;
+    size_t l = dec.size();
+    double prior1 = std::count(y.begin(), y.end(), 1);
+    double prior0 = l - prior1;
+    double hi_target = (prior1 + 1.0) / (prior1 + 2.0);
+    double lo_target = 1 / (prior0 + 2.0);
+    vector<double> t(l);
+
+    *A = 0.0;
+    *B = log((prior0 + 1.0) / (prior1 + 1.0));
+    double fval = 0.0;
+    for (size_t i = 0; i < l; ++i)
+    {
+        t[i] = y[i] > 0 ? hi_target : lo_target;
+        double fApB = dec[i] * *A + *B;
+        fval += fApB >= 0 ? t[i] * fApB + log(1 + exp(-fApB))
+            : (t[i] - 1) * fApB + log(1 + exp(fApB));
+    }
+    for (int iter = 0; iter < max_iter; ++iter)
+    {
+        // Gradient and Hessian with H' = H + sigma * I
+        double h11 = sigma;
+        double h22 = sigma;
+        double h21 = 0.0;
+        double g1 = 0.0;
+        double g2 = 0.0;
+        for (size_t i = 0; i < l; ++i)
+        {
+            double fApB = dec[i] * *A + *B;
+            double p, q;
+            if (fApB >= 0)
+            {
+                p = exp(-fApB) / (1.0 + exp(-fApB));
+                q = 1.0 / (1.0 + exp(-fApB));
+            }
+            else
+            {
+                p = 1.0 / (1.0 + exp(fApB));
+                q = exp(fApB) / (1.0 + exp(fApB));
+            }
+            double d2 = p * q;
+            h11 += dec[i] * dec[i] * d2;
+            h22 += d2;
+            h21 += dec[i] * d2;
+            double d1 = t[i] - p;
+            g1 += dec[i] * d1;
+            g2 += d1;
+        }
+        if (fabs(g1) < eps && fabs(g2) < eps)
+        {
+            break;
+        }
+
+        // Newton direction with line search
+        double det = h11 * h22 - h21 * h21;
+        double dA = -(h22 * g1 - h21 * g2) / det;
+        double dB = -(-h21 * g1 + h11 * g2) / det;
+        double gd = g1 * dA + g2 * dB;
+        double step = 1;
+        while (step >= min_step)
+        {
+            double new_A = *A + step * dA;
+            double new_B = *B + step * dB;
+            double new_f = 0.0;
+            for (size_t i = 0; i < l; ++i)
+            {
+                double fApB = dec[i] * new_A + new_B;
+                new_f += fApB >= 0 ? t[i] * fApB + log(1 + exp(-fApB))
+                    : (t[i] - 1) * fApB + log(1 + exp(fApB));
+            }
+            if (new_f < fval + 0.0001 * step * gd)
+            {
+                *A = new_A;
+                *B = new_B;
+                fval = new_f;
+                break;
+            }
+            step /= 2.0;
+        }
+        if (step < min_step)
+        {
+            break;
+        }
+    }
+}
+
+// One support vector for each pair holding its weights, attached to the
+// first class of the pair with coefficient 1 and 0 elsewhere
+svm_model* BuildModel(const vector<int> &label_list,
+        const vector<vector<double>> &pair_w, const vector<double> &prob_A,
+        const vector<double> &prob_B, const svm_parameter &param)
+{
+    int nr_class = static_cast<int>(label_list.size());
+    int pair_num = static_cast<int>(pair_w.size());
+    int dim = static_cast<int>(pair_w[0].size()) - 1;
+
+    svm_model *model = static_cast<svm_model*>(malloc(sizeof(svm_model)));
+    model->param = param;
+    model->nr_class = nr_class;
+    model->l = pair_num;
+    model->free_sv = 1;  // SV[0] holds all the nodes
+    model->sv_indices = NULL;
+    model->label = static_cast<int*>(malloc(nr_class * sizeof(int)));
+    model->nSV = static_cast<int*>(malloc(nr_class * sizeof(int)));
+    for (int i = 0; i < nr_class; ++i)
+    {
+        model->label[i] = label_list[i];
+        model->nSV[i] = nr_class - 1 - i;
+    }
+
+    model->rho = static_cast<double*>(malloc(pair_num * sizeof(double)));
+    model->probA = static_cast<double*>(malloc(pair_num * sizeof(double)));
+    model->probB = static_cast<double*>(malloc(pair_num * sizeof(double)));
+    model->SV = static_cast<svm_node**>(malloc(pair_num * sizeof(svm_node*)));
+    svm_node *x_space = static_cast<svm_node*>(
+            malloc(pair_num * (dim + 1) * sizeof(svm_node)));
+    model->sv_coef = static_cast<double**>(
+            malloc((nr_class - 1) * sizeof(double*)));
+    for (int i = 0; i < nr_class - 1; ++i)
+    {
+        model->sv_coef[i] = static_cast<double*>(
+                calloc(pair_num, sizeof(double)));
+    }
+
+    for (int i = 0, p = 0; i < nr_class; ++i)
+        for (int j = i + 1; j < nr_class; ++j, ++p)
+        {
+            model->rho[p] = -pair_w[p][dim];
+            model->probA[p] = prob_A[p];
+            model->probB[p] = prob_B[p];
+            model->sv_coef[j - 1][p] = 1;
+
+            svm_node *sv = x_space + p * (dim + 1);
+            for (int d = 0; d < dim; ++d)
+            {
+                sv[d].index = d + 1;
+                sv[d].value = pair_w[p][d];
+            }
+            sv[dim].index = -1;
+            model->SV[p] = sv;
+        }
+    return model;
+}
+}  // namespace
+
+svm_model* TrainLinearSvm(const Mat &feats, const vector<int> &labels,
+        const svm_parameter &param, LinearSvmType type,
+        LinearSvmState *state)
+{
+    Mat feats_float;
+    feats.convertTo(feats_float, CV_32F);
+    int n = feats_float.rows;
+
+    // Classes in the order of appearance as libsvm
+    vector<int> label_list;
+    map<int, int> label_map;
+    vector<int> cls(n);
+    for (int i = 0; i < n; ++i)
+    {
+        auto iter = label_map.find(labels[i]);
+        if (iter == label_map.end())
+        {
+            iter = label_map.insert(std::make_pair(labels[i],
+                        static_cast<int>(label_list.size()))).first;
+            label_list.push_back(labels[i]);
+        }
+        cls[i] = iter->second;
+    }
+    int nr_class = static_cast<int>(label_list.size());
+    if (nr_class < 2)
+    {
+        printf("At least two classes are needed for SVM.\n");
+        return NULL;
+    }
+    int pair_num = nr_class * (nr_class - 1) / 2;
+
+    // Warm start only if the last rows are kept in front with the same
+    // classes, so each problem sees them first in the same order
+    LinearSvmState cold_state;
+    bool warm = state != nullptr && !state->alpha.empty()
+        && state->type == type && state->c == param.C
+        && state->labels.size() <= labels.size()
+        && std::equal(state->labels.begin(), state->labels.end(),
+                labels.begin());
+    if (warm)
+    {
+        set<int> last_labels(state->labels.begin(), state->labels.end());
+        warm = static_cast<int>(last_labels.size()) == nr_class;
+    }
+    if (!warm)
+    {
+        state = state == nullptr ? &cold_state : state;
+        *state = LinearSvmState();
+    }
+
+    // Decision values of the held-out folds for the sigmoids, the
+    // rows of the last fold are never held out
+    vector<int> &fold = state->fold;
+    int last_num = static_cast<int>(fold.size());
+    fold.resize(n);
+    for (int i = last_num; i < n; ++i)
+    {
+        fold[i] = i % LINEAR_SVM_PROB_FOLD;
+    }
+    std::mt19937 rng(last_num);
+    std::shuffle(fold.begin() + last_num, fold.end(), rng);
+    vector<vector<vector<double>>> fold_w;
+    TrainFolds(feats_float, cls, nr_class, fold, param.C, type,
+            &state->alpha, &fold_w);
+    state->labels = labels;
+    state->type = type;
+    state->c = param.C;
+    vector<double> dec(static_cast<size_t>(n) * pair_num);
+    for (int i = 0; i < n; ++i)
+        for (int p = 0; p < pair_num; ++p)
+        {
+            dec[i * pair_num + p] = GetDecision(fold_w[fold[i]][p],
+                    feats_float.ptr<float>(i));
+        }
+    vector<double> prob_A(pair_num);
+    vector<double> prob_B(pair_num);
+    for (int i = 0, p = 0; i < nr_class; ++i)
+        for (int j = i + 1; j < nr_class; ++j, ++p)
+        {
+            vector<double> pair_dec;
+            vector<int> pair_y;
+            for (int r = 0; r < n; ++r)
+            {
+                if (cls[r] == i || cls[r] == j)
+                {
+                    pair_dec.push_back(dec[r * pair_num + p]);
+                    pair_y.push_back(cls[r] == i ? 1 : -1);
+                }
+            }
+            SigmoidTrain(pair_dec, pair_y, &prob_A[p], &prob_B[p]);
+        }
+
+    return BuildModel(label_list, fold_w[LINEAR_SVM_PROB_FOLD], prob_A,
+            prob_B, param);
+}
+}  // namespace ghk
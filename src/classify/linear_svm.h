@@ -0,0 +1,48 @@
+/*************************************************************************
+    > File Name: linear_svm.h
+    > Author: Guo Hengkai
+    > Description: Linear SVM trainer function definition
+    > Created Time: Sun 12 Jul 2015 10:16:42 AM CST
+ ************************************************************************/
+#ifndef FINAL_LINEAR_SVM_H_
+#define FINAL_LINEAR_SVM_H_
+
+#include "common.h"
+#include "libsvm/svm.h"
+
+namespace ghk
+{
+enum LinearSvmType
+{
+    LINEAR_SVM_OVO = 0,  // one binary problem for each pair of classes
+    LINEAR_SVM_OVR       // one binary problem for each class
+};
+
+const int LINEAR_SVM_MAX_ITER = 1000;
+const double LINEAR_SVM_EPS = 0.1;  // stopping tolerance of projected gradient
+const int LINEAR_SVM_PROB_FOLD = 5;  // cross validation for probability
+
+// Dual variables of the last training for warm start
+struct LinearSvmState
+{
+    LinearSvmState(): type(LINEAR_SVM_OVO), c(0) {}
+
+    vector<int> labels;
+    vector<int> fold;  // cross validation fold of each row
+    vector<vector<double>> alpha;  // for each fold and binary problem
+    LinearSvmType type;
+    double c;
+};
+
+// Train L1-loss linear SVMs on the dense CV_32F rows with dual coordinate
+// descent (Hsieh et al. 2008). The pairwise decision functions and their
+// Platt sigmoids are written into a libsvm model, so it can be saved,
+// loaded and predicted by libsvm as a LINEAR C_SVC model.
+// If the state is given, the solver starts from it when the rows begin
+// with the rows of the last training, and the new state is saved back.
+svm_model* TrainLinearSvm(const Mat &feats, const vector<int> &labels,
+        const svm_parameter &param, LinearSvmType type,
+        LinearSvmState *state = nullptr);
+}  // namespace ghk
+
+#endif  // FINAL_LINEAR_SVM_H_
@@ -9,6 +9,7 @@
 
 #include "common.h"
 #include "dataset.h"
+#include "feature_cache.h"
 
 namespace ghk
 {
@@ -24,6 +25,8 @@ public:
             vector<int> *labels) = 0;
     virtual bool FullTest(const Dataset &dataset,
             const string &dir) { return false; }
+    // Reuse the features of the images seen in the earlier runs
+    virtual void SetFeatureCache(FeatureCache *cache) {}
     int PredictSingle(const Mat &image);
 };
 }  // namespace ghk
@@ -65,6 +65,8 @@ bool SvmClassifier::Load(const string &model_name)
         svm_free_and_destroy_model(&svm_model_);
     }
     svm_model_ = svm_load_model((model_name + FILE_EXT).c_str());
+    linear_state_ = LinearSvmState();
+    CompileWeights();
 
     return true;
 }
@@ -77,6 +79,7 @@ bool SvmClassifier::Train(const Mat &feats, const vector<int> &labels)
     {
         svm_free_and_destroy_model(&svm_model_);
     }
+    linear_state_ = LinearSvmState();
 
     // Calculate the normalization parameters
     TrainNormalize(feats, &normA_, &normB_);
@@ -87,20 +90,63 @@ bool SvmClassifier::Train(const Mat &feats, const vector<int> &labels)
 
     // Prepare the input for SVM
     svm_parameter param;
-    svm_problem problem;
-    svm_node* x_space = NULL;
-
     PrepareParameter(feats_norm.cols, &param);
-    PrepareProblem(feats_norm, labels, &problem, x_space);
+    if (use_linear_solver_ && param.kernel_type == LINEAR)
+    {
+        svm_model_ = TrainLinearSvm(feats_norm, labels, param, linear_type_,
+                &linear_state_);
+        if (svm_model_ == NULL)
+        {
+            svm_destroy_param(&param);
+            return false;
+        }
+        CompileWeights();
+        svm_destroy_param(&param);
+        return true;
+    }
+    TrainProblem problem;
+    PrepareProblem(feats_norm, labels, &problem);
+    feats_norm.release();
 
     // Train the SVM model
     svm_set_print_string_function(&PrintNull);  // Close the training output
-    svm_model_ = svm_train(&problem, &param);
+    svm_model_ = svm_train(&problem.problem, &param);
+
+    // The support vectors point into the problem, which is released
+    // when returning
+    CompactModel();
+    CompileWeights();
 
     // Release the parameters for training
     svm_destroy_param(&param);
     return true;
+}
+
+bool SvmClassifier::Retrain(const Mat &feats, const vector<int> &labels)
+{
+    if (linear_state_.alpha.empty())
+    {
+        return Train(feats, labels);
+    }
 
+    // The rows of the last training are normalized in the same way
+    Mat feats_norm;
+    Normalize(feats, &feats_norm);
+
+    svm_parameter param;
+    PrepareParameter(feats_norm.cols, &param);
+    svm_model *model = TrainLinearSvm(feats_norm, labels, param,
+            linear_type_, &linear_state_);
+    svm_destroy_param(&param);
+    if (model == NULL)
+    {
+        return false;
+    }
+    svm_free_and_destroy_model(&svm_model_);
+    svm_model_ = model;
+    CompileWeights();
+
+    return true;
 }
 
 bool SvmClassifier::Predict(const Mat &feats, vector<int> *labels) const
@@ -117,6 +163,16 @@ bool SvmClassifier::Predict(const Mat &feats, vector<int> *labels,
         return false;
     }
 
+    if (use_weight_bank_ && !weights_.empty())
+    {
+        return PredictLinear(feats, labels, probs);
+    }
+    return PredictLibsvm(feats, labels, probs);
+}
+
+bool SvmClassifier::PredictLibsvm(const Mat &feats, vector<int> *labels,
+        vector<float> *probs) const
+{
     int m = feats.cols;
     int n = feats.rows;
     labels->clear();
@@ -129,41 +185,46 @@ bool SvmClassifier::Predict(const Mat &feats, vector<int> *labels,
     Mat feats_norm;
     Normalize(feats, &feats_norm);
 
-    // Predict using SVM
-    svm_node *x = static_cast<svm_node*>(malloc((m + 1) * sizeof(svm_node)));
+    // Predict using SVM, the buffers are shared by all the rows and the
+    // zeros are left out as libsvm does
+    vector<svm_node> x(m + 1);
+    vector<double> prob(svm_model_->nr_class);
     for (int i = 0; i < n; ++i)
     {
+        const float *row = feats_norm.ptr<float>(i);
+        int k = 0;
         for (int j = 0; j < m; ++j)
         {
-            x[j].index = j + 1;
-            x[j].value = feats_norm.at<float>(i, j);
+            if (row[j] != 0)
+            {
+                x[k].index = j + 1;
+                x[k].value = row[j];
+                ++k;
+            }
         }
-        x[m].index = -1;
+        x[k].index = -1;
 
         if (probs == nullptr)
         {
-            labels->push_back(svm_predict(svm_model_, x));
+            labels->push_back(svm_predict(svm_model_, x.data()));
         }
         else
         {
-            double *prob = static_cast<double*>(
-                    malloc(svm_model_->nr_class * sizeof(double)));
-            int label = svm_predict_probability(svm_model_, x, prob);
+            int label = svm_predict_probability(svm_model_, x.data(),
+                    prob.data());
             labels->push_back(label);
             int idx = 0;
-            for (int k = 0; k < svm_model_->nr_class; ++k)
+            for (int c = 0; c < svm_model_->nr_class; ++c)
             {
-                if (label == svm_model_->label[k])
+                if (label == svm_model_->label[c])
                 {
-                    idx = k;
+                    idx = c;
                     break;
                 }
             }
             probs->push_back(prob[idx]);
-            delete prob;
         }
     }
-    free(x);
 
     return true;
 }
@@ -173,6 +234,284 @@ void SvmClassifier::Normalize(const Mat &feats, Mat *feats_norm) const
     ghk::Normalize(normA_, normB_, feats, feats_norm);
 }
 
+double SigmoidPredict(double dec_value, double A, double B)
+{
+    double fApB = dec_value * A + B;
+    if (fApB >= 0)
+    {
+        return exp(-fApB) / (1.0 + exp(-fApB));
+    }
+    else
+    {
+        return 1.0 / (1 + exp(fApB));
+    }
+}
+
+// Same as multiclass_probability in libsvm (method 2 of Wu, Lin and Weng)
+void MulticlassProbability(int k, const vector<double> &r, double *p)
+{
+    int max_iter = max(100, k);
+    vector<double> Q(k * k);
+    vector<double> Qp(k);
+    double eps = 0.005 / k;
+
+    for (int t = 0; t < k; ++t)
+    {
+        p[t] = 1.0 / k;
+        Q[t * k + t] = 0;
+        for (int j = 0; j < t; ++j)
+        {
+            Q[t * k + t] += r[j * k + t] * r[j * k + t];
+            Q[t * k + j] = Q[j * k + t];
+        }
+        for (int j = t + 1; j < k; ++j)
+        {
+            Q[t * k + t] += r[j * k + t] * r[j * k + t];
+            Q[t * k + j] = -r[j * k + t] * r[t * k + j];
+        }
+    }
+    for (int iter = 0; iter < max_iter; ++iter)
+    {
+        double pQp = 0;
+        for (int t = 0; t < k; ++t)
+        {
+            Qp[t] = 0;
+            for (int j = 0; j < k; ++j)
+            {
+                Qp[t] += Q[t * k + j] * p[j];
+            }
+            pQp += p[t] * Qp[t];
+        }
+        double max_error = 0;
+        for (int t = 0; t < k; ++t)
+        {
+            double error = fabs(Qp[t] - pQp);
+            if (error > max_error)
+            {
+                max_error = error;
+            }
+        }
+        if (max_error < eps)
+        {
+            break;
+        }
+
+        for (int t = 0; t < k; ++t)
+        {
+            double diff = (-Qp[t] + pQp) / Q[t * k + t];
+            p[t] += diff;
+            pQp = (pQp + diff * (diff * Q[t * k + t] + 2 * Qp[t]))
+                / (1 + diff) / (1 + diff);
+            for (int j = 0; j < k; ++j)
+            {
+                Qp[j] = (Qp[j] + diff * Q[t * k + j]) / (1 + diff);
+                p[j] /= (1 + diff);
+            }
+        }
+    }
+}
+
+bool SvmClassifier::CompileWeights()
+{
+    weights_ = Mat();
+    bias_ = Mat();
+    if (svm_model_ == NULL || svm_model_->param.svm_type != C_SVC
+            || svm_model_->param.kernel_type != LINEAR)
+    {
+        return false;
+    }
+
+    int nr_class = svm_model_->nr_class;
+    int dim = normA_.cols;
+    vector<int> start(nr_class, 0);
+    for (int i = 1; i < nr_class; ++i)
+    {
+        start[i] = start[i - 1] + svm_model_->nSV[i - 1];
+    }
+
+    // Sum the weighted support vectors for each pair
+    Mat weights = Mat::zeros(nr_class * (nr_class - 1) / 2, dim, CV_64F);
+    Mat bias(1, weights.rows, CV_64F);
+    for (int i = 0, p = 0; i < nr_class; ++i)
+        for (int j = i + 1; j < nr_class; ++j, ++p)
+        {
+            double *w = weights.ptr<double>(p);
+            int idx[2] = {i, j};
+            double *coef[2] = {svm_model_->sv_coef[j - 1],
+                               svm_model_->sv_coef[i]};
+            for (int c = 0; c < 2; ++c)
+                for (int k = 0; k < svm_model_->nSV[idx[c]]; ++k)
+                {
+                    int sv = start[idx[c]] + k;
+                    for (const svm_node *node = svm_model_->SV[sv];
+                            node->index != -1; ++node)
+                    {
+                        if (node->index <= dim)
+                        {
+                            w[node->index - 1] += coef[c][sv] * node->value;
+                        }
+                    }
+                }
+
+            // Fold the normalization: w' = w / B, b = -w' * A - rho
+            double b = -svm_model_->rho[p];
+            for (int d = 0; d < dim; ++d)
+            {
+                double norm = normB_.at<float>(0, d);
+                w[d] = norm != 0 ? w[d] / norm : 0;
+                b -= w[d] * normA_.at<float>(0, d);
+            }
+            bias.at<double>(0, p) = b;
+        }
+
+    weights_ = weights;
+    bias_ = bias;
+    return true;
+}
+
+bool SvmClassifier::GetLinearWeights(Mat *weights, Mat *bias,
+        vector<int> *labels) const
+{
+    if (weights == nullptr || bias == nullptr || labels == nullptr
+            || weights_.empty())
+    {
+        return false;
+    }
+    weights_.convertTo(*weights, CV_32F);
+    bias_.convertTo(*bias, CV_32F);
+    labels->assign(svm_model_->label, svm_model_->label + svm_model_->nr_class);
+    return true;
+}
+
+bool SvmClassifier::PredictLinear(const Mat &feats, vector<int> *labels,
+        vector<float> *probs) const
+{
+    int n = feats.rows;
+    int nr_class = svm_model_->nr_class;
+    labels->clear();
+    if (probs != nullptr)
+    {
+        probs->clear();
+    }
+    if (n == 0)
+    {
+        return true;
+    }
+
+    // Decision values of all pairs for the whole batch, summed in double
+    // as libsvm does
+    Mat feats_double;
+    feats.convertTo(feats_double, CV_64F);
+    Mat dec;
+    cv::gemm(feats_double, weights_, 1.0, cv::repeat(bias_, n, 1), 1.0,
+            dec, cv::GEMM_2_T);
+
+    bool use_prob = probs != nullptr && svm_model_->probA != NULL
+        && svm_model_->probB != NULL;
+    const double min_prob = 1e-7;
+    vector<double> pairwise_prob(nr_class * nr_class);
+    vector<double> prob_estimates(nr_class);
+    vector<int> vote(nr_class);
+    vector<int> tie_rows;
+    for (int r = 0; r < n; ++r)
+    {
+        const double *dec_row = dec.ptr<double>(r);
+        int idx = 0;
+        bool is_tie = false;
+        if (use_prob)
+        {
+            for (int i = 0, p = 0; i < nr_class; ++i)
+                for (int j = i + 1; j < nr_class; ++j, ++p)
+                {
+                    double prob = SigmoidPredict(dec_row[p],
+                            svm_model_->probA[p], svm_model_->probB[p]);
+                    prob = min(max(prob, min_prob), 1 - min_prob);
+                    pairwise_prob[i * nr_class + j] = prob;
+                    pairwise_prob[j * nr_class + i] = 1 - prob;
+                }
+            if (nr_class == 2)
+            {
+                prob_estimates[0] = pairwise_prob[1];
+                prob_estimates[1] = pairwise_prob[nr_class];
+            }
+            else
+            {
+                MulticlassProbability(nr_class, pairwise_prob,
+                        &prob_estimates[0]);
+            }
+            for (int i = 1; i < nr_class; ++i)
+            {
+                if (prob_estimates[i] > prob_estimates[idx])
+                {
+                    idx = i;
+                }
+            }
+            for (int i = 0; i < nr_class; ++i)
+            {
+                is_tie |= i != idx && prob_estimates[idx]
+                    - prob_estimates[i] < WEIGHT_BANK_MARGIN;
+            }
+            probs->push_back(prob_estimates[idx]);
+        }
+        else
+        {
+            std::fill(vote.begin(), vote.end(), 0);
+            for (int i = 0, p = 0; i < nr_class; ++i)
+                for (int j = i + 1; j < nr_class; ++j, ++p)
+                {
+                    ++vote[dec_row[p] > 0 ? i : j];
+                    is_tie |= fabs(dec_row[p]) < WEIGHT_BANK_MARGIN;
+                }
+            for (int i = 1; i < nr_class; ++i)
+            {
+                if (vote[i] > vote[idx])
+                {
+                    idx = i;
+                }
+            }
+            if (probs != nullptr)
+            {
+                probs->push_back(1.0f);
+            }
+        }
+        labels->push_back(svm_model_->label[idx]);
+        if (is_tie)
+        {
+            tie_rows.push_back(r);
+        }
+    }
+
+    // The rows close to a tie may be flipped by the rounding of the
+    // folded weights, so they are scored by libsvm instead
+    if (!tie_rows.empty())
+    {
+        Mat tie_feats(static_cast<int>(tie_rows.size()), feats.cols,
+                feats.type());
+        for (size_t i = 0; i < tie_rows.size(); ++i)
+        {
+            feats.row(tie_rows[i]).copyTo(
+                    tie_feats.row(static_cast<int>(i)));
+        }
+        vector<int> tie_labels;
+        vector<float> tie_probs;
+        if (!PredictLibsvm(tie_feats, &tie_labels,
+                    use_prob ? &tie_probs : nullptr))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < tie_rows.size(); ++i)
+        {
+            (*labels)[tie_rows[i]] = tie_labels[i];
+            if (use_prob)
+            {
+                (*probs)[tie_rows[i]] = tie_probs[i];
+            }
+        }
+    }
+
+    return true;
+}
+
 void SvmClassifier::PrepareParameter(int feat_dim, svm_parameter *param) const
 {
     // default values
@@ -194,27 +533,78 @@ void SvmClassifier::PrepareParameter(int feat_dim, svm_parameter *param) const
     param->weight = NULL;
 }
 
-void SvmClassifier::PrepareProblem(const Mat &feats, const vector<int> &labels,
-        svm_problem *problem, svm_node *x_space) const
+void SvmClassifier::PrepareProblem(const Mat &feats,
+        const vector<int> &labels, TrainProblem *problem) const
 {
     int m = feats.cols;
     int n = feats.rows;
-    problem->l = n;
-    problem->y = static_cast<double*>(malloc(n * sizeof(double)));
-    problem->x = static_cast<svm_node**>(malloc(n * sizeof(svm_node*)));
-    x_space = static_cast<svm_node*>(malloc(n * (m + 1) * sizeof(svm_node)));
 
-    for (int i = 0, k = 0; i < problem->l; ++i) {
-        problem->y[i] = labels[i];
-        problem->x[i] = &x_space[k];
+    // Size the arena once so the row pointers stay valid
+    size_t node_num = n;
+    for (int i = 0; i < n; ++i)
+    {
+        const float *row = feats.ptr<float>(i);
+        node_num += std::count_if(row, row + m,
+                [](float value) { return value != 0; });
+    }
+    problem->nodes.resize(node_num);
+    problem->x.resize(n);
+    problem->y.resize(n);
 
-        for (int32_t j = 0; j < feats.cols; ++j, ++k) {
-            x_space[k].index = j + 1;
-            x_space[k].value = feats.at<float>(i, j);
+    svm_node *node = problem->nodes.data();
+    for (int i = 0; i < n; ++i)
+    {
+        const float *row = feats.ptr<float>(i);
+        problem->y[i] = labels[i];
+        problem->x[i] = node;
+        for (int j = 0; j < m; ++j)
+        {
+            if (row[j] != 0)
+            {
+                node->index = j + 1;
+                node->value = row[j];
+                ++node;
+            }
         }
+        (node++)->index = -1;
+    }
 
-        x_space[k++].index = -1;
+    problem->problem.l = n;
+    problem->problem.y = problem->y.data();
+    problem->problem.x = problem->x.data();
+}
+
+void SvmClassifier::CompactModel()
+{
+    if (svm_model_ == NULL || svm_model_->free_sv || svm_model_->l == 0)
+    {
+        return;
     }
 
+    // Copy the support vectors into one block owned by the model, which
+    // is freed with it as a loaded model
+    size_t node_num = 0;
+    for (int i = 0; i < svm_model_->l; ++i)
+    {
+        const svm_node *node = svm_model_->SV[i];
+        while ((node++)->index != -1)
+        {
+            ++node_num;
+        }
+        ++node_num;
+    }
+    svm_node *block = static_cast<svm_node*>(
+            malloc(node_num * sizeof(svm_node)));
+    svm_node *dst = block;
+    for (int i = 0; i < svm_model_->l; ++i)
+    {
+        const svm_node *src = svm_model_->SV[i];
+        svm_model_->SV[i] = dst;
+        do
+        {
+            *dst++ = *src;
+        } while ((src++)->index != -1);
+    }
+    svm_model_->free_sv = 1;
 }
 }  // namespace ghk
@@ -9,38 +9,91 @@
 
 #include "classifier.h"
 #include "common.h"
+#include "linear_svm.h"
 #include "libsvm/svm.h"
 
 namespace ghk
 {
+// Rows of the weight bank with a decision value or a probability gap
+// below the margin are scored by libsvm, so the labels are the same
+const double WEIGHT_BANK_MARGIN = 1e-3;
+
 class SvmClassifier: public Classifier
 {
 public:
-    explicit SvmClassifier(float c = 125): svm_model_(NULL), c_(c) {}
+    explicit SvmClassifier(float c = 125): svm_model_(NULL), c_(c),
+        use_weight_bank_(true), use_linear_solver_(true),
+        linear_type_(LINEAR_SVM_OVO) {}
     ~SvmClassifier();
 
     virtual bool Save(const string &model_name) const;
     virtual bool Load(const string &model_name);
 
     virtual bool Train(const Mat &feats, const vector<int> &labels);
+    // The linear solver starts from the dual variables of the last
+    // training and the normalization is kept
+    virtual bool Retrain(const Mat &feats, const vector<int> &labels);
     virtual bool Predict(const Mat &feats, vector<int> *labels) const;
     virtual bool Predict(const Mat &feats, vector<int> *labels,
             vector<float> *probs) const;
 
     inline void set_c(float c) { c_ = c; }
+    // Score linear models with the dense weight bank instead of libsvm
+    inline void set_use_weight_bank(bool use_weight_bank)
+    {
+        use_weight_bank_ = use_weight_bank;
+    }
+    inline bool has_weight_bank() const { return !weights_.empty(); }
+    // Train linear kernel with dual coordinate descent instead of libsvm
+    inline void set_use_linear_solver(bool use_linear_solver)
+    {
+        use_linear_solver_ = use_linear_solver;
+    }
+    inline void set_linear_type(LinearSvmType linear_type)
+    {
+        linear_type_ = linear_type;
+    }
+    // Weights and bias of each one-vs-one pair for linear kernel in
+    // float, the decision value is positive for labels[i] of pair (i, j)
+    bool GetLinearWeights(Mat *weights, Mat *bias, vector<int> *labels) const;
 
 private:
+    // Training problem for libsvm, the nonzero values of all the rows
+    // are stored in one arena
+    struct TrainProblem
+    {
+        svm_problem problem;
+        vector<svm_node> nodes;
+        vector<svm_node*> x;
+        vector<double> y;
+    };
+
     svm_model *svm_model_;
     float c_;  // Penalty coefficient
 
     // Normalization parameters: X' = (X - A) / B
     Mat normA_;
     Mat normB_;
+
+    // Dense weight bank for linear kernel in double, one row for each
+    // one-vs-one pair with the normalization folded in: dec = W * X + b
+    Mat weights_;
+    Mat bias_;
+    bool use_weight_bank_;
+    bool use_linear_solver_;
+    LinearSvmType linear_type_;
+    LinearSvmState linear_state_;  // for retraining
     
     void Normalize(const Mat &feats, Mat *feats_norm) const;
+    bool CompileWeights();
+    bool PredictLinear(const Mat &feats, vector<int> *labels,
+            vector<float> *probs) const;
+    bool PredictLibsvm(const Mat &feats, vector<int> *labels,
+            vector<float> *probs) const;
     void PrepareParameter(int feat_dim, svm_parameter *param) const;
     void PrepareProblem(const Mat &feats, const vector<int> &labels,
-            svm_problem *problem, svm_node *x_space) const;
+            TrainProblem *problem) const;
+    void CompactModel();
 };
 }  // namespace ghk
 
@@ -5,16 +5,40 @@
     > Created Time: Fri 15 May 2015 04:37:28 PM CST
  ************************************************************************/
 #include "dataset.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <random>
 #include <sstream>
 #include "common.h"
 #include "mat_util.h"
 #include "math_util.h"
 #include "file_util.h"
+#include "rotate_augmenter.h"
+#include "thread_pool.h"
+#include "timer.h"
 
 namespace ghk
 {
-Dataset::Dataset(const string &base_dir): base_dir_(base_dir)
+const char PACK_MAGIC[8] = {'G', 'H', 'K', 'P', 'A', 'C', 'K', '1'};
+const size_t PACK_ALIGN = 64;  // alignment of the pixels of each image
+
+Dataset::Dataset(const string &base_dir): base_dir_(base_dir),
+    pack_data_(nullptr), pack_size_(0), neg_per_frame_(NEG_PER_FRAME),
+    cache_bytes_(0), cache_capacity_(IMAGE_CACHE_BYTES),
+    cache_hit_(0), cache_miss_(0)
 {
+    if (access((base_dir_ + PACK_NAME).c_str(), R_OK) == 0)
+    {
+        if (LoadPack(base_dir_ + PACK_NAME))
+        {
+            return;
+        }
+        printf("Fail to load the packed dataset, parse the lists instead.\n");
+    }
+
     // Load class names
     label_name_.clear();
     label_name_map_.clear();
@@ -24,32 +48,42 @@ Dataset::Dataset(const string &base_dir): base_dir_(base_dir)
         return;
     }
 
-    // Load positive classification data
+    // Load positive classification lists
+    Timer timer;
+    timer.Start();
     for (int i = 0; i < 2; ++i)
     {
         c_label_[i].clear();
         c_image_[i].clear();
     }
+    vector<ClassifyFile> files;
     for (int i = 1; i <= 10; ++i)
     {
         std::stringstream ss;
         ss << i;
         string data_dir = base_dir_ + CLASSIFY_DIR + "/" + ss.str() + "/";
-        if (!LoadClassifyImages(data_dir, i, POS_C_TEST_NUM))
+        if (!LoadClassifyLists(data_dir, i, POS_C_TEST_NUM, &files))
         {
             return;
         }
     }
 
-    // Load negative classification data
+    // Load negative classification lists
     string data_dir = base_dir + CLASSIFY_DIR + NEG_DIR + "/";
-    if (!LoadClassifyImages(data_dir, 0, -1))
+    if (!LoadClassifyLists(data_dir, 0, -1, &files))
     {
         return;
     }
 
-    printf("Load %zu train images and %zu test images for classification.\n",
-            GetClassifyNum(true), GetClassifyNum(false));
+    // Decode all the images in parallel
+    if (!LoadClassifyImages(files))
+    {
+        return;
+    }
+
+    printf("Load %zu train images and %zu test images for classification"
+            " in %0.3fs.\n", GetClassifyNum(true), GetClassifyNum(false),
+            timer.Snapshot());
 
     // Load detection data
     d_name_list_.clear();
@@ -64,6 +98,13 @@ Dataset::Dataset(const string &base_dir): base_dir_(base_dir)
     printf("Load %zu image names for detection.\n", GetFullImageNum());
 }
 
+Dataset::~Dataset()
+{
+    if (pack_data_ != nullptr)
+    {
+        munmap(pack_data_, pack_size_);
+    }
+}
 
 int Dataset::GetClassifyLabel(bool is_train, size_t idx) const
 {
@@ -119,15 +160,93 @@ bool Dataset::GetFullImage(size_t idx, Mat *image) const
     {
         return false;
     }
-    *image = cv::imread(d_name_list_[idx], 1);
-    if (image->empty())
+    if (is_packed())
+    {
+        *image = d_image_[idx];
+        return true;
+    }
+    if (GetCachedImage(idx, image))
+    {
+        return true;
+    }
+
+    // Decode without holding the lock
+    Mat full_image = cv::imread(d_name_list_[idx], 1);
+    if (full_image.empty())
     {
         printf("Fail to load %s.\n", d_name_list_[idx].c_str());
         return false;
     }
+    AddCachedImage(idx, full_image);
+    *image = full_image;
     return true;
 }
 
+void Dataset::set_cache_capacity(size_t cache_capacity)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    cache_capacity_ = cache_capacity;
+    EvictCachedImages();
+}
+
+void Dataset::GetCacheStat(size_t *hit_num, size_t *miss_num) const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    *hit_num = cache_hit_;
+    *miss_num = cache_miss_;
+}
+
+void Dataset::PrintCacheStat() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    size_t total = cache_hit_ + cache_miss_;
+    printf("Image cache: %zu hits, %zu misses (%0.2f%% hit), "
+            "%zu images in %0.1fMB\n", cache_hit_, cache_miss_,
+            100.0f * cache_hit_ / max(total, size_t(1)),
+            cache_list_.size(), cache_bytes_ / 1048576.0f);
+}
+
+bool Dataset::GetCachedImage(size_t idx, Mat *image) const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto iter = cache_map_.find(idx);
+    if (iter == cache_map_.end())
+    {
+        ++cache_miss_;
+        return false;
+    }
+    ++cache_hit_;
+    cache_list_.splice(cache_list_.begin(), cache_list_, iter->second);
+    *image = iter->second->second.clone();
+    return true;
+}
+
+void Dataset::AddCachedImage(size_t idx, const Mat &image) const
+{
+    size_t bytes = image.total() * image.elemSize();
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (bytes > cache_capacity_ || cache_map_.count(idx) > 0)
+    {
+        return;
+    }
+    // The caller keeps the decoded image, so store a copy
+    cache_list_.push_front(std::make_pair(idx, image.clone()));
+    cache_map_[idx] = cache_list_.begin();
+    cache_bytes_ += bytes;
+    EvictCachedImages();
+}
+
+void Dataset::EvictCachedImages() const
+{
+    while (cache_bytes_ > cache_capacity_ && !cache_list_.empty())
+    {
+        const Mat &image = cache_list_.back().second;
+        cache_bytes_ -= image.total() * image.elemSize();
+        cache_map_.erase(cache_list_.back().first);
+        cache_list_.pop_back();
+    }
+}
+
 bool Dataset::GetDetectLabels(bool is_train, size_t idx, vector<int> *labels) const
 {
     return GetDetectLabels(GetDetectIdx(is_train, idx), labels);
@@ -151,55 +270,105 @@ bool Dataset::GetRandomNegImage(size_t neg_num, Size image_size,
         return false;
     }
 
-    int iter = 0;
-    const int max_iter = 1000000;
-    if (is_augment)
-    {
-        neg_num *= (AUGMENT_TIMES + 1);
-    }
+    // Each round samples a batch of frames in parallel, and each frame
+    // gives at most neg_per_frame_ windows
+    const size_t max_frame = 1000000 / NEG_TRY_TIMES;
+    size_t per_frame = max(neg_per_frame_, size_t(1));
+    size_t sample_num = 0;
+    size_t frame_num = 0;
     images->clear();
-    while (images->size() < neg_num && iter <= max_iter)
+    while (sample_num < neg_num && frame_num < max_frame)
     {
-        auto idx = Random(GetDetectNum(true));
-        Mat image;
-        GetDetectImage(true, idx, &image);
-
-        auto size_idx = Random(SIZE_LIST.size());
-        auto size = SIZE_LIST[size_idx];
-        auto pos_x = Random(image.cols - size + 1);
-        auto pos_y = Random(image.rows - size + 1);
-        
-        Rect rect(pos_x, pos_y, size, size);
-        if (IsNegativeImage(true, idx, rect))
+        size_t batch_num = min((neg_num - sample_num + per_frame - 1)
+                / per_frame, max_frame - frame_num);
+        vector<size_t> idxs(batch_num);
+        vector<unsigned int> seeds(batch_num);
+        for (size_t i = 0; i < batch_num; ++i)
         {
-            image = image(rect);
-            cv::resize(image, image, image_size);
-            cv::cvtColor(image, image, CV_BGR2GRAY);
-            images->push_back(image);
-
-            if (is_augment)
-            {
-                for (int i = 0; i < AUGMENT_TIMES; ++i)
-                {
-                    Mat rot_img = image.clone();
-                    RotateImage(rot_img, Random(AUGMENT_ROTATE * 2 + 1)
-                            - AUGMENT_ROTATE);
-                    images->push_back(rot_img);
-                }
-            }
+            idxs[i] = Random(GetDetectNum(true));
+            seeds[i] = rand();
         }
-
-        ++iter;
+        vector<vector<Mat>> batch(batch_num);
+        ThreadPool::Default().ParallelFor(batch_num,
+                [&](size_t i, int thread_id) {
+            SampleNegImage(idxs[i], per_frame, image_size, is_augment,
+                    seeds[i], &batch[i]);
+        });
+
+        // Keep the order of frames so that the result is reproducible
+        size_t group = is_augment ? AUGMENT_TIMES + 1 : 1;
+        for (auto &frame_samples: batch)
+        {
+            size_t num = min(frame_samples.size() / group,
+                    neg_num - sample_num);
+            images->insert(images->end(), frame_samples.begin(),
+                    frame_samples.begin() + num * group);
+            sample_num += num;
+        }
+        frame_num += batch_num;
     }
 
-    if (iter > max_iter)
+    if (sample_num < neg_num)
     {
         printf("Only %zu negative images.\n", images->size());
         return false;
     }
-    else
+    return true;
+}
+
+void Dataset::SampleNegImage(size_t idx, size_t sample_num, Size image_size,
+        bool is_augment, unsigned int seed, vector<Mat> *images) const
+{
+    images->clear();
+    Mat image;
+    if (!GetDetectImage(true, idx, &image))
     {
-        return true;
+        return;
+    }
+    std::mt19937 rng(seed);
+
+    // Draw candidates with the sizes in turn from a random start, so that
+    // every scale gets the same share of the windows
+    size_t cand_num = sample_num * NEG_TRY_TIMES;
+    size_t size_begin = rng() % SIZE_LIST.size();
+    vector<Rect> cands;
+    cands.reserve(cand_num);
+    for (size_t i = 0; i < cand_num; ++i)
+    {
+        int size = SIZE_LIST[(size_begin + i) % SIZE_LIST.size()];
+        if (size > image.cols || size > image.rows)
+        {
+            continue;
+        }
+        int x = rng() % (image.cols - size + 1);
+        int y = rng() % (image.rows - size + 1);
+        cands.push_back(Rect(x, y, size, size));
+    }
+
+    std::uniform_int_distribution<int> angle_dist(-AUGMENT_ROTATE,
+            AUGMENT_ROTATE);
+    size_t num = 0;
+    for (size_t i = 0; i < cands.size() && num < sample_num; ++i)
+    {
+        if (!IsNegativeImage(true, idx, cands[i]))
+        {
+            continue;
+        }
+        Mat sample;
+        cv::resize(image(cands[i]), sample, image_size);
+        cv::cvtColor(sample, sample, CV_BGR2GRAY);
+        images->push_back(sample);
+        if (is_augment)
+        {
+            for (int k = 0; k < AUGMENT_TIMES; ++k)
+            {
+                Mat rot_img;
+                RotateAugmenter::Default().Rotate(sample, angle_dist(rng),
+                        &rot_img);
+                images->push_back(rot_img);
+            }
+        }
+        ++num;
     }
 }
 
@@ -213,6 +382,9 @@ bool Dataset::GetDetectPosImage(Size image_size,
 
     images->clear();
     labels->clear();
+    vector<Mat> crops;
+    vector<RotateJob> jobs;
+    vector<size_t> rot_idx;  // position in images of each job
     for (size_t i = 0; i < GetDetectNum(true); ++i)
     {
         if (i % 100 == 0)
@@ -220,49 +392,140 @@ bool Dataset::GetDetectPosImage(Size image_size,
             printf("%zu(%zu), ", i, images->size());
             fflush(stdout);
         }
+
+        // Only the windows near the annotations can be positive
+        vector<Rect> rects;
+        vector<int> rect_labels;
+        GetPositiveCandidates(true, i, &rects);
+        for (auto &rect: rects)
+        {
+            rect_labels.push_back(IsPositiveImage(true, i, rect));
+        }
+        if (std::count_if(rect_labels.begin(), rect_labels.end(),
+                    [](int label) { return label > 0; }) == 0)
+        {
+            continue;
+        }
+
         Mat image;
         GetDetectImage(true, i, &image);
-
-        for (auto size: SIZE_LIST)
+        for (size_t j = 0; j < rects.size(); ++j)
         {
-            for (int x = 0; x < image.cols; x += DETECT_STEP)
-                for (int y = 0; y < image.rows; y += DETECT_STEP)
+            Rect rect = rects[j];
+            int label = rect_labels[j];
+            if (label <= 0 || rect.x + rect.width >= image.cols
+                    || rect.y + rect.height >= image.rows)
+            {
+                continue;
+            }
+
+            Mat resize_temp;
+            cv::resize(image(rect), resize_temp, image_size);
+            cv::cvtColor(resize_temp, resize_temp, CV_BGR2GRAY);
+            images->push_back(resize_temp);
+            labels->push_back(label);
+            if (is_augment)
+            {
+                // Rotate the color crop at its own size, then resize it.
+                // The crop is copied so the frame is not kept alive.
+                size_t src = crops.size();
+                crops.push_back(image(rect).clone());
+                for (int i = 0; i < AUGMENT_TIMES; ++i)
                 {
-                    if (x + size >= image.cols || y + size >= image.rows)
-                    {
-                        continue;
-                    }
-                    Rect rect(x, y, size, size);
-                    int label;
-                    if ((label = IsPositiveImage(true, i, rect)) > 0)
-                    {
-                        Mat temp = image(rect).clone();
-                        Mat resize_temp;
-                        cv::resize(temp, resize_temp, image_size);
-                        cv::cvtColor(resize_temp, resize_temp, CV_BGR2GRAY);
-                        images->push_back(resize_temp);
-                        labels->push_back(label);
-                        if (is_augment)
-                        {
-                            for (int i = 0; i < AUGMENT_TIMES; ++i)
-                            {
-                                Mat rot_img = temp.clone();
-                                RotateImage(rot_img, Random(AUGMENT_ROTATE * 2 + 1)
-                                        - AUGMENT_ROTATE);
-                                cv::resize(rot_img, rot_img, image_size);
-                                cv::cvtColor(rot_img, rot_img, CV_BGR2GRAY);
-                                images->push_back(rot_img);
-                                labels->push_back(label);
-                            }
-                        }
-                    }
+                    jobs.push_back(RotateJob{src, crops.size(),
+                            Random(AUGMENT_ROTATE * 2 + 1)
+                            - AUGMENT_ROTATE});
+                    crops.push_back(Mat());
+                    rot_idx.push_back(images->size());
+                    images->push_back(Mat());
+                    labels->push_back(label);
                 }
+            }
         }
     }
+
+    // The crop sizes are in SIZE_LIST, so the rotation maps are bounded
+    RotateAugmenter::Default().RotateBatch(&crops, jobs);
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        Mat &rot_img = (*images)[rot_idx[i]];
+        cv::resize(crops[jobs[i].dst], rot_img, image_size);
+        cv::cvtColor(rot_img, rot_img, CV_BGR2GRAY);
+    }
     printf("\n");
     return true;
 }
 
+void Dataset::GetPositiveCandidates(bool is_train, size_t idx,
+        vector<Rect> *rects) const
+{
+    // Windows are sorted as the scan of sizes, x and y in GetDetectPosImage
+    struct Candidate
+    {
+        size_t size_idx;
+        int x;
+        int y;
+
+        bool operator<(const Candidate &rhs) const
+        {
+            if (size_idx != rhs.size_idx) return size_idx < rhs.size_idx;
+            if (x != rhs.x) return x < rhs.x;
+            return y < rhs.y;
+        }
+        bool operator==(const Candidate &rhs) const
+        {
+            return size_idx == rhs.size_idx && x == rhs.x && y == rhs.y;
+        }
+    };
+
+    // The rate of intersection over bounding box is at most the product
+    // of the rates in both axes. In one axis the rate is at most the ratio
+    // of the lengths, and the distance of the centers is at most
+    // (a + b) / 2 * (1 - t) / (1 + t) for lengths a and b.
+    const float t = INTERSECT_UNION_RATE_POS;
+    vector<Candidate> candidates;
+    for (auto &pos: d_rect_[GetDetectIdx(is_train, idx)])
+    {
+        for (size_t k = 0; k < SIZE_LIST.size(); ++k)
+        {
+            float size = SIZE_LIST[k];
+            if (min(size, static_cast<float>(pos.width))
+                    < t * max(size, static_cast<float>(pos.width)) - 1
+                    || min(size, static_cast<float>(pos.height))
+                    < t * max(size, static_cast<float>(pos.height)) - 1)
+            {
+                continue;
+            }
+
+            // Range of the window corner, with one pixel of slack
+            float dx = (size + pos.width) * 0.5f * (1 - t) / (1 + t) + 1;
+            float dy = (size + pos.height) * 0.5f * (1 - t) / (1 + t) + 1;
+            float x0 = pos.x + (pos.width - size) * 0.5f;
+            float y0 = pos.y + (pos.height - size) * 0.5f;
+            int gx_begin = max(0, cvCeil((x0 - dx) / DETECT_STEP));
+            int gx_end = cvFloor((x0 + dx) / DETECT_STEP);
+            int gy_begin = max(0, cvCeil((y0 - dy) / DETECT_STEP));
+            int gy_end = cvFloor((y0 + dy) / DETECT_STEP);
+            for (int gx = gx_begin; gx <= gx_end; ++gx)
+                for (int gy = gy_begin; gy <= gy_end; ++gy)
+                {
+                    candidates.push_back(Candidate{k, gx * DETECT_STEP,
+                            gy * DETECT_STEP});
+                }
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+            candidates.end());
+
+    rects->clear();
+    for (auto &candidate: candidates)
+    {
+        int size = SIZE_LIST[candidate.size_idx];
+        rects->push_back(Rect(candidate.x, candidate.y, size, size));
+    }
+}
+
 bool Dataset::IsNegativeImage(bool is_train, size_t idx, const Rect &rect) const
 {
     idx = GetDetectIdx(is_train, idx);
@@ -317,8 +580,8 @@ bool Dataset::LoadLabelNames(const string &list_name)
     return true;
 }
 
-bool Dataset::LoadClassifyImages(const string &data_dir,
-        int label, int test_num)
+bool Dataset::LoadClassifyLists(const string &data_dir,
+        int label, int test_num, vector<ClassifyFile> *files)
 {
     string list_name = data_dir + FILE_LIST_NAME;
     FILE *in_file;
@@ -335,19 +598,12 @@ bool Dataset::LoadClassifyImages(const string &data_dir,
         if (fgets(name, MAX_LINE, in_file) == NULL)
         {
             printf("No enough data.\n");
+            fclose(in_file);
             return false;
         }
 
         ClipString(name);
-        Mat image = cv::imread(data_dir + name, 1);
-        if (image.empty())
-        {
-            printf("Fail to load %s.\n", (data_dir + name).c_str());
-            cout << data_dir + name << endl;
-            return false;
-        }
-        c_image_[1].push_back(image);
-        c_label_[1].push_back(label);
+        files->push_back(ClassifyFile{data_dir + name, label, 1});
     }
 
     // Train images or test images
@@ -359,16 +615,31 @@ bool Dataset::LoadClassifyImages(const string &data_dir,
     while (fgets(name, MAX_LINE, in_file) != NULL)
     {
         ClipString(name);
-        Mat image = cv::imread(data_dir + name, 1);
-        if (image.empty())
+        files->push_back(ClassifyFile{data_dir + name, label, idx});
+    }
+    fclose(in_file);
+    return true;
+}
+
+bool Dataset::LoadClassifyImages(const vector<ClassifyFile> &files)
+{
+    vector<Mat> images(files.size());
+    ThreadPool::Default().ParallelFor(files.size(),
+            [&](size_t i, int thread_id) {
+        images[i] = cv::imread(files[i].path, 1);
+    });
+
+    // Report the first failure in the order of the lists
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (images[i].empty())
         {
-            printf("Fail to load %s.\n", (data_dir + name).c_str());
+            printf("Fail to load %s.\n", files[i].path.c_str());
             return false;
         }
-        c_image_[idx].push_back(image);
-        c_label_[idx].push_back(label);
+        c_image_[files[i].split].push_back(images[i]);
+        c_label_[files[i].split].push_back(files[i].label);
     }
-    fclose(in_file);
     return true;
 }
 
@@ -460,4 +731,284 @@ void Dataset::DrawRectAndLabel(const vector<Rect> &rects, const vector<int> &lab
                 cv::FONT_HERSHEY_PLAIN, 0.8, CV_RGB(0, 0, 0));
     }
 }
+
+// Sequential reader over the mapped pack
+struct PackReader
+{
+    const char *data;
+    size_t size;
+    size_t pos;
+
+    template <typename T>
+    bool Read(T *value)
+    {
+        if (pos + sizeof(T) > size)
+        {
+            return false;
+        }
+        memcpy(value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool ReadString(string *str)
+    {
+        uint32_t len;
+        if (!Read(&len) || pos + len > size)
+        {
+            return false;
+        }
+        str->assign(data + pos, len);
+        pos += len;
+        return true;
+    }
+
+    // Header of the image pixels inside the mapping
+    bool ReadImage(Mat *image)
+    {
+        int32_t rows, cols, type;
+        uint64_t offset;
+        if (!Read(&rows) || !Read(&cols) || !Read(&type) || !Read(&offset))
+        {
+            return false;
+        }
+        Mat header(rows, cols, type, const_cast<char*>(data) + offset);
+        if (offset + header.total() * header.elemSize() > size)
+        {
+            return false;
+        }
+        *image = header;
+        return true;
+    }
+};
+
+template <typename T>
+void WriteValue(FILE *out_file, const T &value)
+{
+    fwrite(&value, sizeof(T), 1, out_file);
+}
+
+// Write the pixels at an aligned offset, and the header into the meta
+bool WriteImage(FILE *out_file, const Mat &image, std::ostringstream *meta)
+{
+    Mat data = image.isContinuous() ? image : image.clone();
+    long pos = ftell(out_file);
+    long padding = (PACK_ALIGN - pos % PACK_ALIGN) % PACK_ALIGN;
+    for (long i = 0; i < padding; ++i)
+    {
+        fputc(0, out_file);
+    }
+    uint64_t offset = pos + padding;
+    size_t bytes = data.total() * data.elemSize();
+    if (fwrite(data.data, 1, bytes, out_file) != bytes)
+    {
+        return false;
+    }
+
+    int32_t header[3] = {data.rows, data.cols, data.type()};
+    meta->write(reinterpret_cast<const char*>(header), sizeof(header));
+    meta->write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    return true;
+}
+
+bool Dataset::Pack(const string &pack_name) const
+{
+    FILE *out_file;
+    if ((out_file = fopen(pack_name.c_str(), "wb")) == nullptr)
+    {
+        printf("Fail to open %s.\n", pack_name.c_str());
+        return false;
+    }
+
+    // Magic and the offset of the meta data, which is written last
+    fwrite(PACK_MAGIC, 1, sizeof(PACK_MAGIC), out_file);
+    WriteValue(out_file, static_cast<uint64_t>(0));
+
+    std::ostringstream meta;
+    auto write_meta = [&meta](const void *value, size_t size) {
+        meta.write(static_cast<const char*>(value), size);
+    };
+    auto write_string = [&write_meta](const string &str) {
+        uint32_t len = static_cast<uint32_t>(str.size());
+        write_meta(&len, sizeof(len));
+        write_meta(str.data(), len);
+    };
+
+    uint32_t label_num = static_cast<uint32_t>(label_name_.size());
+    write_meta(&label_num, sizeof(label_num));
+    for (auto &name: label_name_)
+    {
+        write_string(name);
+    }
+
+    // Classification images of the train and test splits
+    for (int i = 0; i < 2; ++i)
+    {
+        uint64_t num = c_image_[i].size();
+        write_meta(&num, sizeof(num));
+        for (size_t j = 0; j < num; ++j)
+        {
+            int32_t label = c_label_[i][j];
+            write_meta(&label, sizeof(label));
+            if (!WriteImage(out_file, c_image_[i][j], &meta))
+            {
+                fclose(out_file);
+                return false;
+            }
+        }
+    }
+
+    // Detection images with the annotations
+    printf("Packing %zu detection images...\n", GetFullImageNum());
+    uint64_t num = GetFullImageNum();
+    write_meta(&num, sizeof(num));
+    for (size_t i = 0; i < num; ++i)
+    {
+        if (i % 100 == 0)
+        {
+            printf("%zu, ", i);
+            fflush(stdout);
+        }
+        write_string(d_name_list_[i]);
+        uint32_t rect_num = static_cast<uint32_t>(d_rect_[i].size());
+        write_meta(&rect_num, sizeof(rect_num));
+        for (size_t j = 0; j < rect_num; ++j)
+        {
+            int32_t value[5] = {d_rect_[i][j].x, d_rect_[i][j].y,
+                d_rect_[i][j].width, d_rect_[i][j].height, d_label_[i][j]};
+            write_meta(value, sizeof(value));
+        }
+        Mat image;
+        if (!GetFullImage(i, &image) || !WriteImage(out_file, image, &meta))
+        {
+            fclose(out_file);
+            return false;
+        }
+    }
+    printf("\n");
+
+    uint64_t meta_offset = ftell(out_file);
+    string meta_str = meta.str();
+    fwrite(meta_str.data(), 1, meta_str.size(), out_file);
+    fseek(out_file, sizeof(PACK_MAGIC), SEEK_SET);
+    WriteValue(out_file, meta_offset);
+    bool flag = !ferror(out_file);
+    fclose(out_file);
+    if (!flag)
+    {
+        printf("Fail to write %s.\n", pack_name.c_str());
+    }
+    return flag;
+}
+
+bool Dataset::LoadPack(const string &pack_name)
+{
+    int fd = open(pack_name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Fail to open %s.\n", pack_name.c_str());
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0
+            || file_stat.st_size < static_cast<off_t>(sizeof(PACK_MAGIC)
+                + sizeof(uint64_t)))
+    {
+        close(fd);
+        return false;
+    }
+
+    // Read-only mapping, so a write through the returned headers faults
+    // instead of changing the frame for the later readers
+    pack_size_ = file_stat.st_size;
+    void *data = mmap(nullptr, pack_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("Fail to map %s.\n", pack_name.c_str());
+        return false;
+    }
+    pack_data_ = data;
+
+    PackReader reader{static_cast<const char*>(data), pack_size_, 0};
+    uint64_t meta_offset;
+    bool flag = memcmp(data, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0;
+    reader.pos = sizeof(PACK_MAGIC);
+    flag = flag && reader.Read(&meta_offset) && meta_offset < pack_size_;
+    reader.pos = meta_offset;
+
+    uint32_t label_num = 0;
+    flag = flag && reader.Read(&label_num);
+    for (uint32_t i = 0; flag && i < label_num; ++i)
+    {
+        string name;
+        flag = reader.ReadString(&name);
+        label_name_map_[name] = i;
+        label_name_.push_back(name);
+    }
+
+    for (int i = 0; flag && i < 2; ++i)
+    {
+        uint64_t num = 0;
+        flag = reader.Read(&num);
+        for (uint64_t j = 0; flag && j < num; ++j)
+        {
+            int32_t label;
+            Mat image;
+            flag = reader.Read(&label) && reader.ReadImage(&image);
+            c_label_[i].push_back(label);
+            c_image_[i].push_back(image);
+        }
+    }
+
+    uint64_t num = 0;
+    flag = flag && reader.Read(&num);
+    for (uint64_t i = 0; flag && i < num; ++i)
+    {
+        string name;
+        uint32_t rect_num = 0;
+        flag = reader.ReadString(&name) && reader.Read(&rect_num);
+        vector<Rect> rects;
+        vector<int> labels;
+        for (uint32_t j = 0; flag && j < rect_num; ++j)
+        {
+            int32_t value[5];
+            flag = reader.Read(&value);
+            rects.push_back(Rect(value[0], value[1], value[2], value[3]));
+            labels.push_back(value[4]);
+        }
+        Mat image;
+        flag = flag && reader.ReadImage(&image);
+        d_name_list_.push_back(name);
+        d_rect_.push_back(rects);
+        d_label_.push_back(labels);
+        d_image_.push_back(image);
+    }
+
+    if (!flag)
+    {
+        printf("Broken packed dataset %s.\n", pack_name.c_str());
+        munmap(pack_data_, pack_size_);
+        pack_data_ = nullptr;
+        pack_size_ = 0;
+        label_name_.clear();
+        label_name_map_.clear();
+        for (int i = 0; i < 2; ++i)
+        {
+            c_label_[i].clear();
+            c_image_[i].clear();
+        }
+        d_name_list_.clear();
+        d_rect_.clear();
+        d_label_.clear();
+        d_image_.clear();
+        return false;
+    }
+
+    printf("Load %zu train images and %zu test images for classification.\n",
+            GetClassifyNum(true), GetClassifyNum(false));
+    printf("Load %zu images for detection from %s.\n", GetFullImageNum(),
+            pack_name.c_str());
+    return true;
+}
 }  // namespace ghk
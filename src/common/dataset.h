@@ -7,6 +7,8 @@
 #ifndef FINAL_DATASET_H_
 #define FINAL_DATASET_H_
 
+#include <list>
+#include <mutex>
 #include "common.h"
 
 #define INDEX(x) (x?0:1)
@@ -33,23 +35,43 @@ const int DETECT_NAME_LENGTH = 25;  // length of image name for detection
 const float INTERSECT_UNION_RATE = 0.5;
 const float INTERSECT_UNION_RATE_POS = 0.7;
 const int DETECT_STEP = 10;
+const size_t IMAGE_CACHE_BYTES = size_t(512) << 20;  // decoded full images
+const string PACK_NAME = "/dataset.pack";  // packed dataset in base_dir
+const size_t NEG_PER_FRAME = 8;  // random negative windows of each frame
+const size_t NEG_TRY_TIMES = 4;  // candidates drawn for each window
 
 class Dataset
 {
 public:
+    // Open base_dir/dataset.pack if it exists, or parse the lists and
+    // images in base_dir otherwise
     Dataset(const string &base_dir);
+    ~Dataset();
+
+    // Write the decoded images, labels, rects and splits into one binary
+    // file, which is mapped into memory when the dataset is opened
+    bool Pack(const string &pack_name) const;
+    inline bool is_packed() const { return pack_data_ != nullptr; }
 
     int GetClassifyLabel(bool is_train, size_t idx) const;
+    // Without img_size the image is a header over the stored image, which
+    // is the read-only mapping for a packed dataset, so clone it before
+    // modifying
     bool GetClassifyImage(bool is_train, size_t idx,
             Mat *image, Size img_size = Size()) const;
 
     bool GetDetectLabels(size_t idx, vector<int> *labels) const;
     bool GetDetectRects(size_t idx, vector<Rect> *rects) const;
+    // For a packed dataset the image is a zero-copy header over the
+    // read-only mapping, so clone it before modifying. Otherwise the
+    // decoded images are kept in a LRU cache and the image is a copy.
     bool GetFullImage(size_t idx, Mat *image) const;
     bool GetDetectLabels(bool is_train, size_t idx, vector<int> *labels) const;
     bool GetDetectRects(bool is_train, size_t idx, vector<Rect> *rects) const;
     bool GetDetectImage(bool is_train, size_t idx, Mat *image) const;
 
+    // Sample batches of frames in parallel with a few windows of each,
+    // reproducible for the same seed of rand()
     bool GetRandomNegImage(size_t neg_num, Size image_size,
             vector<Mat> *images, bool is_augment = true) const;
     bool GetDetectPosImage(Size image_size, vector<Mat> *images,
@@ -73,10 +95,38 @@ public:
         return is_train ? d_rect_.size() - DETECT_TEST_NUM : DETECT_TEST_NUM;
     }
 
+    // Max bytes of the decoded image cache, 0 to disable it
+    void set_cache_capacity(size_t cache_capacity);
+    void GetCacheStat(size_t *hit_num, size_t *miss_num) const;
+    void PrintCacheStat() const;
+    // Max random negative windows from one frame, the balance between the
+    // diversity of frames and the number of decoded frames
+    inline void set_neg_per_frame(size_t neg_per_frame)
+    {
+        neg_per_frame_ = max(neg_per_frame, size_t(1));
+    }
+
 private:
+    // Classification image to decode, in the order of the lists
+    struct ClassifyFile
+    {
+        string path;
+        int label;
+        int split;  // 0 for train, 1 for test
+    };
+
     bool LoadLabelNames(const string &list_name);
-    bool LoadClassifyImages(const string &data_dir, int label, int test_num);
+    bool LoadClassifyLists(const string &data_dir, int label, int test_num,
+            vector<ClassifyFile> *files);
+    bool LoadClassifyImages(const vector<ClassifyFile> &files);
     bool LoadDetectLists(const string &data_dir);
+    bool LoadPack(const string &pack_name);
+    void SampleNegImage(size_t idx, size_t sample_num, Size image_size,
+            bool is_augment, unsigned int seed, vector<Mat> *images) const;
+    // Grid windows which may reach INTERSECT_UNION_RATE_POS with an
+    // annotation, in the order of the exhaustive scan
+    void GetPositiveCandidates(bool is_train, size_t idx,
+            vector<Rect> *rects) const;
     inline size_t GetDetectIdx(bool is_train, size_t idx) const
     {
         return is_train ? idx : idx + GetDetectNum(true);
@@ -92,6 +142,25 @@ private:
     vector<vector<Rect>> d_rect_;
     vector<vector<int>> d_label_;
     vector<string> d_name_list_;
+    vector<Mat> d_image_;  // read-only headers over the mapping when packed
+
+    void *pack_data_;
+    size_t pack_size_;
+    size_t neg_per_frame_;
+
+    // LRU cache of full images, the most recently used at the front
+    typedef std::list<std::pair<size_t, Mat>> CacheList;
+    mutable std::mutex cache_mutex_;
+    mutable CacheList cache_list_;
+    mutable map<size_t, CacheList::iterator> cache_map_;
+    mutable size_t cache_bytes_;
+    size_t cache_capacity_;
+    mutable size_t cache_hit_;
+    mutable size_t cache_miss_;
+
+    bool GetCachedImage(size_t idx, Mat *image) const;
+    void AddCachedImage(size_t idx, const Mat &image) const;
+    void EvictCachedImages() const;
 };
 
 }  // namespace ghk
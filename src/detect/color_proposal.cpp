@@ -0,0 +1,64 @@
+/*************************************************************************
+    > File Name: src/detect/color_proposal.cpp
+    > Author: Guo Hengkai
+    > Description: Color segmentation region proposal class implementation
+    > Created Time: Tue 23 Jun 2015 10:21:16 AM CST
+ ************************************************************************/
+#include "color_proposal.h"
+
+namespace ghk
+{
+bool ColorProposal::GetRegions(const Mat &image, vector<Rect> *regions) const
+{
+    if (regions == nullptr)
+    {
+        return false;
+    }
+    regions->clear();
+
+    Mat mask;
+    if (!GetColorMask(image, &mask))
+    {
+        return false;
+    }
+
+    // Connected components of the mask
+    vector<vector<Point>> contours;
+    cv::findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+    for (auto &contour: contours)
+    {
+        Rect rect = cv::boundingRect(contour);
+        if (rect.width >= min_size_ || rect.height >= min_size_)
+        {
+            regions->push_back(rect);
+        }
+    }
+    return true;
+}
+
+bool ColorProposal::GetColorMask(const Mat &image, Mat *mask) const
+{
+    if (image.empty() || image.channels() != 3 || mask == nullptr)
+    {
+        printf("Color proposal needs a BGR image.\n");
+        return false;
+    }
+
+    // Hue ranges of OpenCV are in [0, 180)
+    Mat hsv;
+    cvtColor(image, hsv, CV_BGR2HSV);
+    Mat red_low, red_high, blue, yellow;
+    cv::inRange(hsv, cv::Scalar(0, 70, 50), cv::Scalar(10, 255, 255), red_low);
+    cv::inRange(hsv, cv::Scalar(160, 70, 50), cv::Scalar(180, 255, 255), red_high);
+    cv::inRange(hsv, cv::Scalar(100, 90, 50), cv::Scalar(130, 255, 255), blue);
+    cv::inRange(hsv, cv::Scalar(15, 100, 80), cv::Scalar(35, 255, 255), yellow);
+    cv::bitwise_or(red_low, red_high, *mask);
+    cv::bitwise_or(*mask, blue, *mask);
+    cv::bitwise_or(*mask, yellow, *mask);
+
+    // Close the gaps of symbols and borders inside signs
+    Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, Size(5, 5));
+    cv::morphologyEx(*mask, *mask, cv::MORPH_CLOSE, kernel);
+    return true;
+}
+}  // namespace ghk
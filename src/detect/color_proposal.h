@@ -0,0 +1,34 @@
+/*************************************************************************
+    > File Name: src/detect/color_proposal.h
+    > Author: Guo Hengkai
+    > Description: Color segmentation region proposal class definition
+    > Created Time: Tue 23 Jun 2015 10:05:47 AM CST
+ ************************************************************************/
+#ifndef FINAL_COLOR_PROPOSAL_H_
+#define FINAL_COLOR_PROPOSAL_H_
+
+#include "common.h"
+#include "dataset.h"
+#include "proposal.h"
+
+namespace ghk
+{
+// Regions of red, blue and yellow pixels, which are the colors of signs
+class ColorProposal: public Proposal
+{
+public:
+    explicit ColorProposal(int min_size = SIZE_LIST[0] / 2):
+        min_size_(min_size) {}
+
+    virtual bool GetRegions(const Mat &image, vector<Rect> *regions) const;
+    // Binary mask of the sign colors after closing
+    bool GetColorMask(const Mat &image, Mat *mask) const;
+
+    inline void set_min_size(int min_size) { min_size_ = min_size; }
+
+private:
+    int min_size_;  // min side of the regions
+};
+}  // namespace ghk
+
+#endif  // FINAL_COLOR_PROPOSAL_H_
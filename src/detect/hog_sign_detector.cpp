@@ -5,21 +5,50 @@
     > Created Time: Wed 17 Jun 2015 11:20:30 AM CST
  ************************************************************************/
 #include "hog_sign_detector.h"
+#include "color_proposal.h"
+#include "mser_proposal.h"
 #include "dataset.h"
 #include "file_util.h"
 #include "sign_detector.h"
 #include "test_util.h"
+#include "timer.h"
 
 namespace ghk
 {
 bool HogSignDetector::Save(const string &model_name) const
 {
-    return classifier_.Save(model_name + "_cl");
+    if (!classifier_.Save(model_name + "_cl"))
+    {
+        return false;
+    }
+    if (!cascade_.empty() && !cascade_.Save(model_name + "_cas"))
+    {
+        printf("Fail to save the soft cascade.\n");
+        return false;
+    }
+    if (!filter_.empty() && !filter_.Save(model_name + "_flt"))
+    {
+        printf("Fail to save the window filter.\n");
+        return false;
+    }
+    return true;
 }
 
 bool HogSignDetector::Load(const string &model_name)
 {
-    return classifier_.Load(model_name + "_cl");
+    if (!classifier_.Load(model_name + "_cl"))
+    {
+        return false;
+    }
+    if (!cascade_.Load(model_name + "_cas"))
+    {
+        printf("No soft cascade for the model.\n");
+    }
+    if (!filter_.Load(model_name + "_flt"))
+    {
+        printf("No window filter for the model.\n");
+    }
+    return true;
 }
 
 bool HogSignDetector::Train(const Dataset &dataset)
@@ -39,6 +68,12 @@ bool HogSignDetector::Train(const Dataset &dataset)
     }
     */
     
+    // Learn the prefilter from the positive crops only
+    if (!filter_.Train(images))
+    {
+        printf("Fail to train the window filter.\n");
+    }
+
     // Train the classifier
     // labels = vector<int>(labels.size(), 1);
     if (!classifier_.Train(dataset, images, labels))
@@ -46,6 +81,19 @@ bool HogSignDetector::Train(const Dataset &dataset)
         return false;
     }
 
+    // Train the soft cascade on the positive and random negative samples
+    printf("Training soft cascade...\n");
+    const HogExtractor &extractor = classifier_.hog_extractor();
+    Mat feats;
+    if (!extractor.ExtractBatch(images, &feats)
+            || !cascade_.Train(feats, labels,
+                extractor.GetCellNum(image_size_.width),
+                extractor.dimension(), cascade_recall_))
+    {
+        printf("Fail to train the soft cascade.\n");
+    }
+    dataset.PrintCacheStat();
+
     return true;
 }
 
@@ -59,6 +107,12 @@ bool HogSignDetector::Test(const Dataset &dataset)
     // size_t n = dataset.GetDetectNum(true);
     int pos_num = 0;
     int win_num = 0; 
+    vector<float> times;
+    Timer timer;
+    cascade_reject_.assign(cascade_.stage_num(), 0);
+    proposal_skip_ = 0;
+    filter_skip_ = 0;
+    size_t proposed_num = 0;
     printf("Start to detect on %zu images...\n", n);
     for (size_t i = 0; i < n; ++i)
     {
@@ -99,96 +153,97 @@ bool HogSignDetector::Test(const Dataset &dataset)
         vector<vector<int>> label_vec;
         vector<vector<float>> prob_vec;
         int temp_num;
+        timer.Start();
         if (!Detect(image_vec, &rect_vec, &label_vec, &prob_vec, &temp_num, false))
         {
             return false;
         }
+        times.push_back(timer.Snapshot());
         win_num += temp_num;
 
+        // Count the ground truth covered by the proposals
+        if (proposal_ && !CountProposed(image, res_rects, &proposed_num))
+        {
+            return false;
+        }
+
         rects.push_back(rect_vec[0]);
         labels.push_back(label_vec[0]);
         probs.push_back(prob_vec[0]);
     }
     printf("\nTotal detected: %zu\n", rects.size());
+    dataset.PrintCacheStat();
 
-    // Evaluate the rectangles
-    Mat rate;
-    bool is_set = false;
-    for (float th = 0.0f; th <= 1.0f; th += 0.02f)
+    // Report the windows skipped by the proposals and their recall
+    if (proposal_)
     {
-        cout << th << ", " << flush;
-        float pos = 0;
-        float neg = 0;
+        size_t total_num = win_num + proposal_skip_ + filter_skip_;
+        printf("Proposals: %zu of %zu windows scanned (%0.2f%% skipped), "
+                "recall %0.2f%%\n", total_num - proposal_skip_, total_num,
+                100.0f * proposal_skip_ / max(total_num, size_t(1)),
+                100.0f * proposed_num / max(pos_num, 1));
+    }
+    if (use_filter_ && !filter_.empty())
+    {
+        size_t total_num = win_num + proposal_skip_ + filter_skip_;
+        printf("Window filter: %zu of %zu windows discarded (%0.2f%%)\n",
+                filter_skip_, total_num,
+                100.0f * filter_skip_ / max(total_num, size_t(1)));
+    }
 
-        for (size_t i = 0; i < n; ++i)
+    // Report the rejection of each cascade stage and the speedup
+    if (use_cascade_ && !cascade_.empty())
+    {
+        size_t remain_num = win_num;
+        for (int t = 0; t < cascade_.stage_num(); ++t)
         {
-            vector<Rect> res_rects;
-            vector<int> res_labels;
-            vector<float> res_probs;
-            for (size_t j = 0; j < rects[i].size(); ++j)
-            {
-                if (probs[i][j] >= th)
-                {
-                    res_rects.push_back(rects[i][j]);
-                    res_labels.push_back(labels[i][j]);
-                    res_probs.push_back(probs[i][j]);
-                }
-            }
-            // MergeRects(res_rects, res_labels, res_probs, 0.667f);
-
-            vector<bool> temp_res(res_labels.size(), false);
-            for (size_t k = 0; k < labels_truth[i].size(); ++k)
-            {
-                Rect rect = rects_truth[i][k];
-                size_t idx = 0;
-                float max_p = -1;
-                for (size_t j = 0; j < res_labels.size(); ++j)
-                {
-                    if (res_labels[j] == labels_truth[i][k] && static_cast<float>(
-                        (rect & res_rects[j]).area())
-                     / ((rect | res_rects[j]).area()) >= 0.5 &&
-                     res_probs[j] > max_p && !temp_res[j])
-                    {
-                        max_p = res_probs[j];
-                        idx = j;
-                    }
-                }
-                if (max_p >= 0)
-                {
-                    temp_res[idx] = true;
-                }
-            }
-
-            for (size_t k = 0; k < res_labels.size(); ++k)
-            {
-                if (temp_res[k])
-                {
-                    ++pos;
-                }
-                else
-                {
-                    ++neg;
-                }
-            }
+            remain_num -= cascade_reject_[t];
+            printf("Cascade stage %d: %0.2f%% windows rejected, "
+                    "%0.2f%% remaining\n", t, 100.0f * cascade_reject_[t]
+                    / max(win_num, 1), 100.0f * remain_num / max(win_num, 1));
         }
 
-        Mat rate_row = Mat::zeros(1, 2, CV_32F);
-        rate_row.at<float>(0, 0) = 1 - pos / pos_num;
-        rate_row.at<float>(0, 1) = neg / win_num;
-        rate.push_back(rate_row);
-
-        if (rate_row.at<float>(0, 1) < 1e-2 && !is_set)
+        size_t speed_num = min(n, CASCADE_SPEED_NUM);
+        float time_cascade = 0;
+        float time_full = 0;
+        bool use_cascade = use_cascade_;
+        use_cascade_ = false;
+        for (size_t i = 0; i < speed_num; ++i)
         {
-            th_ = th;
-            is_set = true;
+            Mat image;
+            dataset.GetDetectImage(false, i, &image);
+            vector<Mat> image_vec(1, image);
+            vector<vector<Rect>> rect_vec;
+            vector<vector<int>> label_vec;
+            vector<vector<float>> prob_vec;
+            timer.Start();
+            Detect(image_vec, &rect_vec, &label_vec, &prob_vec, nullptr, false);
+            time_full += timer.Snapshot();
+            time_cascade += times[i];
         }
+        use_cascade_ = use_cascade;
+        printf("Cascade speedup on %zu images: %0.3fs vs %0.3fs, %0.2fx\n",
+                speed_num, time_cascade, time_full,
+                time_full / max(time_cascade, 1e-6f));
     }
-    cout << endl;
-    SaveMat("./result/dect_curve" + suffix, rate);
-    if (!is_set)
+
+    // Evaluate the rectangles with one matching for all the thresholds
+    vector<bool> results;
+    vector<float> scores;
+    float ap = MatchDetection(rects_truth, labels_truth, rects, labels,
+            probs, &results, &scores, INTERSECT_UNION_RATE);
+    printf("Average precision: %0.2f%%\n", ap * 100);
+    if (results.empty())
     {
         th_ = 1.0f;
     }
+    else
+    {
+        float rate = UpdateThreshold(results, scores,
+                "./result/dect_curve" + suffix, pos_num, win_num, &th_, 1e-2);
+        printf("Recall under 10^-2 FPPW: %0.2f%%, threshold %0.4f\n",
+                rate * 100, th_);
+    }
 
     /*
     // Find the threshold for SVM
@@ -277,7 +332,7 @@ bool HogSignDetector::Detect(const vector<Mat> &images,
         vector<vector<Rect>> *rects, vector<vector<int>> *labels,
         vector<vector<float>> *probs, int *win_num, bool is_merge)
 {
-    if (rects == nullptr || labels == nullptr)
+    if (rects == nullptr || labels == nullptr || probs == nullptr)
     {
         return false;
     }
@@ -288,70 +343,584 @@ bool HogSignDetector::Detect(const vector<Mat> &images,
     {
         *win_num = 0;
     }
-    for (auto image: images)
+
+    if (proposal_type_ == PROPOSAL_MSER && proposal_)
+    {
+        return DetectCandidates(images, rects, labels, probs, win_num,
+                is_merge);
+    }
+
+    cout << "Searching image patches..." << endl;
+    vector<Mat> grays(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        cvtColor(images[i], grays[i], CV_BGR2GRAY);
+    }
+
+    // Prepare the proposal regions
+    std::atomic<bool> flag(true);
+    vector<Mat> integrals(images.size());
+    if (proposal_)
+    {
+        pool().ParallelFor(images.size(), [&](size_t i, int thread_id) {
+            if (!proposal_->GetIntegral(images[i], &integrals[i]))
+            {
+                flag = false;
+            }
+        });
+        if (!flag)
+        {
+            return false;
+        }
+    }
+
+    // Prepare the integral images of the prefilter
+    vector<FilterIntegral> filters(images.size());
+    bool is_filter = use_filter_ && !filter_.empty();
+    if (is_filter)
+    {
+        pool().ParallelFor(images.size(), [&](size_t i, int thread_id) {
+            filter_.GetIntegral(grays[i], &filters[i]);
+        });
+    }
+
+    // Prepare all the scales of all the images
+    vector<DetectLevel> levels;
+    for (size_t i = 0; i < images.size(); ++i)
     {
-        cout << "Searching image patches..." << endl;
-        Mat gray;
-        cvtColor(image, gray, CV_BGR2GRAY);
-        vector<Mat> image_vec;
-        vector<Rect> all_rects;
         for (auto size: SIZE_LIST)
         {
-            for (int x = 0; x < image.cols; x += DETECT_STEP)
-                for (int y = 0; y < image.rows; y += DETECT_STEP)
-                {
-                    if (x + size >= image.cols || y + size >= image.rows)
-                    {
-                        continue;
-                    }
-
-                    Rect rect(x, y, size, size);
-                    Mat image_patch(gray(rect).clone());
-                    resize(image_patch, image_patch, image_size_);
-                    all_rects.push_back(rect);
-                    image_vec.push_back(image_patch);
-                }
+            DetectLevel level;
+            level.image_idx = i;
+            level.size = size;
+            level.integral = &integrals[i];
+            level.filter = is_filter ? &filters[i] : nullptr;
+            levels.push_back(level);
+        }
+    }
+    pool().ParallelFor(levels.size(), [&](size_t i, int thread_id) {
+        if (!PrepareLevel(grays[levels[i].image_idx], &levels[i]))
+        {
+            flag = false;
         }
+    });
+    if (!flag)
+    {
+        return false;
+    }
 
+    // Split the levels into bands of window rows
+    vector<DetectTask> tasks;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        for (int row = 0; row < levels[i].row_num; row += DETECT_BAND_ROWS)
+        {
+            tasks.push_back(DetectTask{i, row,
+                    min(row + DETECT_BAND_ROWS, levels[i].row_num)});
+        }
+    }
+    vector<DetectResult> results(tasks.size());
+    vector<ChunkBuffer> buffers(pool().thread_num());
+    for (auto &buffer: buffers)
+    {
+        PrepareBuffer(!use_pyramid_, &buffer);
+    }
+    pool().ParallelFor(tasks.size(), [&](size_t i, int thread_id) {
+        const DetectLevel &level = levels[tasks[i].level_idx];
+        if (!DetectBand(grays[level.image_idx], level, tasks[i].row_begin,
+                tasks[i].row_end, &buffers[thread_id], &results[i]))
+        {
+            flag = false;
+        }
+    });
+    if (!flag)
+    {
+        return false;
+    }
+
+    // Gather the results in the order of tasks
+    rects->resize(images.size());
+    labels->resize(images.size());
+    probs->resize(images.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        size_t idx = levels[tasks[i].level_idx].image_idx;
+        (*rects)[idx].insert((*rects)[idx].end(),
+                results[i].rects.begin(), results[i].rects.end());
+        (*labels)[idx].insert((*labels)[idx].end(),
+                results[i].labels.begin(), results[i].labels.end());
+        (*probs)[idx].insert((*probs)[idx].end(),
+                results[i].probs.begin(), results[i].probs.end());
         if (win_num != nullptr)
         {
-            *win_num += static_cast<int>(all_rects.size());
+            *win_num += results[i].win_num;
         }
+        AddResultStat(results[i]);
+    }
 
-        cout << "Predicting..." << endl;
-        vector<int> label_vec;
-        vector<float> prob_vec;
-        if (!classifier_.Predict(image_vec, &label_vec, &prob_vec))
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        cout << "Totally " << (*rects)[i].size() << " positions detected." << endl;
+        if (is_merge)
+        {
+            // Merge detect results
+            Merge((*rects)[i], (*labels)[i], (*probs)[i]);
+            cout << "Totally " << (*rects)[i].size() << " positions after merging." << endl;
+        }
+    }
+
+    return true;
+}
+
+bool HogSignDetector::DetectWindows(const Mat &image,
+        const vector<Rect> &windows, vector<Rect> *rects, vector<int> *labels,
+        vector<float> *probs, int *win_num, bool is_merge)
+{
+    if (rects == nullptr || labels == nullptr || probs == nullptr)
+    {
+        return false;
+    }
+    rects->clear();
+    labels->clear();
+    probs->clear();
+    if (win_num != nullptr)
+    {
+        *win_num = 0;
+    }
+
+    Mat gray;
+    cvtColor(image, gray, CV_BGR2GRAY);
+    Rect image_rect(0, 0, gray.cols, gray.rows);
+    FilterIntegral filter;
+    bool is_filter = use_filter_ && !filter_.empty();
+    if (is_filter)
+    {
+        filter_.GetIntegral(gray, &filter);
+    }
+    vector<Rect> valid_windows;
+    valid_windows.reserve(windows.size());
+    for (auto &window: windows)
+    {
+        if (window.area() > 0 && (window & image_rect) == window)
+        {
+            if (is_filter && !filter_.Accept(filter, window))
+            {
+                ++filter_skip_;
+                continue;
+            }
+            valid_windows.push_back(window);
+        }
+    }
+
+    // Score the windows chunk by chunk, all in the patch mode
+    DetectLevel level;
+    level.image_idx = 0;
+    level.size = 0;
+    level.scale = 1.0f;
+    level.step = DETECT_STEP;
+    level.col_num = 0;
+    level.row_num = 0;
+    level.integral = nullptr;
+    level.filter = nullptr;
+    size_t chunk_num = (valid_windows.size() + chunk_size_ - 1) / chunk_size_;
+    vector<DetectResult> results(chunk_num);
+    vector<ChunkBuffer> buffers(pool().thread_num());
+    for (auto &buffer: buffers)
+    {
+        PrepareBuffer(true, &buffer);
+    }
+    std::atomic<bool> flag(true);
+    pool().ParallelFor(chunk_num, [&](size_t i, int thread_id) {
+        ChunkBuffer *buffer = &buffers[thread_id];
+        size_t begin = i * chunk_size_;
+        size_t end = min(begin + chunk_size_, valid_windows.size());
+        results[i].win_num = 0;
+        results[i].reject_num.assign(cascade_.stage_num(), 0);
+        results[i].skip_num = 0;
+        results[i].filter_num = 0;
+        buffer->rects.assign(valid_windows.begin() + begin,
+                valid_windows.begin() + end);
+        if (!ScoreChunk(gray, level, buffer, &results[i]))
+        {
+            flag = false;
+        }
+    });
+    if (!flag)
+    {
+        return false;
+    }
+
+    for (auto &result: results)
+    {
+        rects->insert(rects->end(), result.rects.begin(), result.rects.end());
+        labels->insert(labels->end(), result.labels.begin(),
+                result.labels.end());
+        probs->insert(probs->end(), result.probs.begin(), result.probs.end());
+        if (win_num != nullptr)
+        {
+            *win_num += result.win_num;
+        }
+        AddResultStat(result);
+    }
+    if (is_merge)
+    {
+        Merge(*rects, *labels, *probs);
+    }
+
+    return true;
+}
+
+ThreadPool& HogSignDetector::pool()
+{
+    if (!pool_)
+    {
+        pool_.reset(new ThreadPool(thread_num_));
+    }
+    return *pool_;
+}
+
+bool HogSignDetector::PrepareLevel(const Mat &gray, DetectLevel *level) const
+{
+    int size = level->size;
+    level->col_num = 0;
+    level->row_num = 0;
+    if (!use_pyramid_)
+    {
+        level->scale = 1.0f;
+        level->step = DETECT_STEP;
+        if (gray.cols > size && gray.rows > size)
+        {
+            level->col_num = (gray.cols - size - 1) / DETECT_STEP + 1;
+            level->row_num = (gray.rows - size - 1) / DETECT_STEP + 1;
+        }
+        return true;
+    }
+
+    // Scale the image so that a window covers exactly win_cells cells
+    const HogExtractor &extractor = classifier_.hog_extractor();
+    int cell_size = extractor.cell_size();
+    int win_cells = extractor.GetCellNum(image_size_.width);
+    level->scale = static_cast<float>(win_cells * cell_size) / size;
+    level->step = max(1, cvRound(DETECT_STEP * level->scale / cell_size));
+    Size scale_size(cvRound(gray.cols * level->scale),
+            cvRound(gray.rows * level->scale));
+    if (scale_size.width < win_cells * cell_size
+            || scale_size.height < win_cells * cell_size)
+    {
+        return true;
+    }
+    Mat scale_image;
+    resize(gray, scale_image, scale_size);
+    if (!extractor.ExtractGrid(scale_image, &level->grid))
+    {
+        return false;
+    }
+
+    int grid_w = level->grid.cols;
+    int grid_h = level->grid.rows / extractor.dimension();
+    if (grid_w >= win_cells && grid_h >= win_cells)
+    {
+        level->col_num = (grid_w - win_cells) / level->step + 1;
+        level->row_num = (grid_h - win_cells) / level->step + 1;
+    }
+    return true;
+}
+
+void HogSignDetector::PrepareBuffer(bool use_patch,
+        ChunkBuffer *buffer) const
+{
+    const HogExtractor &extractor = classifier_.hog_extractor();
+    int feat_dim = extractor.GetCellNum(image_size_.width)
+        * extractor.GetCellNum(image_size_.height) * extractor.dimension();
+    buffer->rects.reserve(chunk_size_);
+    buffer->cells.reserve(chunk_size_);
+    buffer->feats.create(chunk_size_, feat_dim, CV_32F);
+    if (use_patch)
+    {
+        buffer->patches.resize(chunk_size_);
+        for (auto &patch: buffer->patches)
+        {
+            patch.create(image_size_, CV_8U);
+        }
+    }
+}
+
+bool HogSignDetector::DetectBand(const Mat &gray, const DetectLevel &level,
+        int row_begin, int row_end, ChunkBuffer *buffer,
+        DetectResult *result) const
+{
+    const HogExtractor &extractor = classifier_.hog_extractor();
+    int cell_size = extractor.cell_size();
+    int size = level.size;
+    result->win_num = 0;
+    result->reject_num.assign(cascade_.stage_num(), 0);
+    result->skip_num = 0;
+    result->filter_num = 0;
+    buffer->rects.clear();
+    buffer->cells.clear();
+    for (int c = 0; c < level.col_num; ++c)
+        for (int r = row_begin; r < row_end; ++r)
+        {
+            int x = c * level.step;
+            int y = r * level.step;
+            if (use_pyramid_)
+            {
+                // Slide the window over cell offsets of the grid
+                buffer->cells.push_back(Point(x, y));
+                x = cvRound(x * cell_size / level.scale);
+                y = cvRound(y * cell_size / level.scale);
+                if (x + size >= gray.cols || y + size >= gray.rows)
+                {
+                    buffer->cells.pop_back();
+                    continue;
+                }
+            }
+            if (level.integral != nullptr
+                    && !IsProposed(*level.integral, Rect(x, y, size, size)))
+            {
+                ++result->skip_num;
+                if (use_pyramid_)
+                {
+                    buffer->cells.pop_back();
+                }
+                continue;
+            }
+            if (level.filter != nullptr
+                    && !filter_.Accept(*level.filter, Rect(x, y, size, size)))
+            {
+                ++result->filter_num;
+                if (use_pyramid_)
+                {
+                    buffer->cells.pop_back();
+                }
+                continue;
+            }
+            buffer->rects.push_back(Rect(x, y, size, size));
+
+            if (static_cast<int>(buffer->rects.size()) >= chunk_size_)
+            {
+                if (!ScoreChunk(gray, level, buffer, result))
+                {
+                    return false;
+                }
+            }
+        }
+
+    if (!buffer->rects.empty())
+    {
+        return ScoreChunk(gray, level, buffer, result);
+    }
+    return true;
+}
+
+bool HogSignDetector::ScoreChunk(const Mat &gray, const DetectLevel &level,
+        ChunkBuffer *buffer, DetectResult *result) const
+{
+    const HogExtractor &extractor = classifier_.hog_extractor();
+    int n = static_cast<int>(buffer->rects.size());
+    Mat feats = buffer->feats.rowRange(0, n);
+    if (!level.grid.empty())
+    {
+        int win_cells = extractor.GetCellNum(image_size_.width);
+        for (int i = 0; i < n; ++i)
+        {
+            extractor.GetWindowFeat(level.grid, buffer->cells[i].x,
+                    buffer->cells[i].y, win_cells, feats.ptr<float>(i));
+        }
+    }
+    else
+    {
+        // Resize into the preallocated patches
+        for (int i = 0; i < n; ++i)
+        {
+            resize(gray(buffer->rects[i]), buffer->patches[i], image_size_);
+        }
+        vector<Mat> image_vec(buffer->patches.begin(),
+                buffer->patches.begin() + n);
+        if (!extractor.ExtractBatch(image_vec, &feats))
         {
             return false;
         }
+    }
 
-        vector<Rect> res_rects;
-        vector<int> res_labels;
-        vector<float> res_probs;
-        for (size_t i = 0; i < all_rects.size(); ++i)
+    result->win_num += n;
+
+    // Reject background windows early with the soft cascade
+    if (use_cascade_ && !cascade_.empty())
+    {
+        int k = 0;
+        for (int i = 0; i < n; ++i)
         {
-            if (label_vec[i] > 0 && prob_vec[i] > th_)  // Positive response
+            int stage = cascade_.Evaluate(feats.ptr<float>(i));
+            if (stage < cascade_.stage_num())
             {
-                res_rects.push_back(all_rects[i]);
-                res_labels.push_back(label_vec[i]);
-                res_probs.push_back(prob_vec[i]);
+                ++result->reject_num[stage];
+                continue;
             }
+            if (k != i)
+            {
+                memcpy(feats.ptr<float>(k), feats.ptr<float>(i),
+                        feats.cols * sizeof(float));
+                buffer->rects[k] = buffer->rects[i];
+            }
+            ++k;
         }
-        cout << "Totally " << res_rects.size() << " positions detected." << endl;
+        n = k;
+        feats = feats.rowRange(0, n);
+    }
 
-        if (is_merge)
+    if (n > 0 && !classifier_.PredictFeats(feats, &buffer->labels,
+                &buffer->probs))
+    {
+        return false;
+    }
+
+    // Only keep the surviving windows
+    for (int i = 0; i < n; ++i)
+    {
+        if (buffer->labels[i] > 0 && buffer->probs[i] > th_)  // Positive response
         {
-            // Merge detect results
-            MergeRects(res_rects, res_labels, res_probs, 0.667f);
-            cout << "Totally " << res_rects.size() << " positions after merging." << endl;
+            result->rects.push_back(buffer->rects[i]);
+            result->labels.push_back(buffer->labels[i]);
+            result->probs.push_back(buffer->probs[i]);
         }
+    }
+    buffer->rects.clear();
+    buffer->cells.clear();
+    return true;
+}
 
-        rects->push_back(res_rects);
-        labels->push_back(res_labels);
-        probs->push_back(res_probs);
+void HogSignDetector::AddResultStat(const DetectResult &result)
+{
+    proposal_skip_ += result.skip_num;
+    filter_skip_ += result.filter_num;
+    for (size_t t = 0; t < result.reject_num.size()
+            && t < cascade_reject_.size(); ++t)
+    {
+        cascade_reject_[t] += result.reject_num[t];
     }
+}
 
+void HogSignDetector::set_proposal_type(ProposalType proposal_type)
+{
+    proposal_type_ = proposal_type;
+    switch (proposal_type)
+    {
+        case PROPOSAL_COLOR:
+            proposal_.reset(new ColorProposal());
+            break;
+        case PROPOSAL_MSER:
+            proposal_.reset(new MserProposal());
+            break;
+        default:
+            proposal_.reset();
+            break;
+    }
+}
+
+bool HogSignDetector::DetectCandidates(const vector<Mat> &images,
+        vector<vector<Rect>> *rects, vector<vector<int>> *labels,
+        vector<vector<float>> *probs, int *win_num, bool is_merge)
+{
+    cout << "Searching candidate windows..." << endl;
+    rects->resize(images.size());
+    labels->resize(images.size());
+    probs->resize(images.size());
+    if (win_num != nullptr)
+    {
+        *win_num = 0;
+    }
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        vector<Rect> windows;
+        if (!proposal_->GetRegions(images[i], &windows))
+        {
+            return false;
+        }
+        int temp_num;
+        if (!DetectWindows(images[i], windows, &(*rects)[i], &(*labels)[i],
+                    &(*probs)[i], &temp_num, is_merge))
+        {
+            return false;
+        }
+        if (win_num != nullptr)
+        {
+            *win_num += temp_num;
+        }
+        proposal_skip_ += max(0, GetFullWindowNum(images[i].size())
+                - static_cast<int>(windows.size()));
+        cout << "Totally " << (*rects)[i].size() << " positions detected in "
+            << temp_num << " candidates." << endl;
+    }
     return true;
 }
+
+int HogSignDetector::GetFullWindowNum(const Size &size) const
+{
+    // Windows of the exhaustive scan in the patch mode
+    int num = 0;
+    for (auto s: SIZE_LIST)
+    {
+        if (size.width > s && size.height > s)
+        {
+            num += ((size.width - s - 1) / DETECT_STEP + 1)
+                * ((size.height - s - 1) / DETECT_STEP + 1);
+        }
+    }
+    return num;
+}
+
+bool HogSignDetector::CountProposed(const Mat &image,
+        const vector<Rect> &truth, size_t *proposed_num) const
+{
+    if (proposal_type_ == PROPOSAL_MSER)
+    {
+        // Covered by a candidate window which is a hit
+        vector<Rect> windows;
+        if (!proposal_->GetRegions(image, &windows))
+        {
+            return false;
+        }
+        for (auto &rect: truth)
+        {
+            for (auto &window: windows)
+            {
+                if (static_cast<float>((rect & window).area())
+                        / (rect | window).area() >= INTERSECT_UNION_RATE)
+                {
+                    ++*proposed_num;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    Mat integral;
+    if (!proposal_->GetIntegral(image, &integral))
+    {
+        return false;
+    }
+    for (auto &rect: truth)
+    {
+        if (IsProposed(integral, rect))
+        {
+            ++*proposed_num;
+        }
+    }
+    return true;
+}
+
+void HogSignDetector::Merge(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs) const
+{
+    if (use_nms_)
+    {
+        SuppressRects(rects, labels, probs, NMS_OVERLAP);
+    }
+    else
+    {
+        MergeRects(rects, labels, probs, MERGE_HIT_RATE);
+    }
+}
 }  // namespace ghk
@@ -7,13 +7,24 @@
 #ifndef FINAL_HOG_SIGN_DETECTOR_H_
 #define FINAL_HOG_SIGN_DETECTOR_H_
 
+#include <memory>
 #include "common.h"
 #include "dataset.h"
 #include "hog_sign_classifier.h"
+#include "proposal.h"
 #include "sign_detector.h"
+#include "soft_cascade.h"
+#include "thread_pool.h"
+#include "window_filter.h"
 
 namespace ghk
 {
+const int DETECT_BAND_ROWS = 4;  // window rows of each detection task
+const int DETECT_CHUNK_SIZE = 512;  // windows scored together
+const size_t CASCADE_SPEED_NUM = 20;  // images to measure the speedup
+const float MERGE_HIT_RATE = 0.667f;
+const float NMS_OVERLAP = 0.5f;
+
 class HogSignDetector: public SignDetector
 {
 public:
@@ -21,7 +32,12 @@ public:
             float c = 125, int img_size = 100,
             bool use_svm = true):
         classifier_(num_orient, cell_size, c, img_size, use_svm),
-        image_size_(Size(img_size, img_size)) {}
+        image_size_(Size(img_size, img_size)), th_(0.0f),
+        use_pyramid_(false), thread_num_(0),
+        chunk_size_(DETECT_CHUNK_SIZE), use_cascade_(false),
+        cascade_recall_(CASCADE_RECALL), use_nms_(false),
+        proposal_type_(PROPOSAL_NONE), proposal_skip_(0),
+        use_filter_(false), filter_skip_(0) {}
     virtual bool Save(const string &model_name) const;
     virtual bool Load(const string &model_name);
     
@@ -32,11 +48,142 @@ public:
     bool Detect(const vector<Mat> &images, vector<vector<Rect>> *rects,
             vector<vector<int>> *labels, vector<vector<float>> *probs,
             int *win_num = nullptr, bool is_merge = true);
+    // Score an explicit list of square windows in one image instead of
+    // scanning every scale, windows outside the image are skipped
+    bool DetectWindows(const Mat &image, const vector<Rect> &windows,
+            vector<Rect> *rects, vector<int> *labels, vector<float> *probs,
+            int *win_num = nullptr, bool is_merge = true);
+
+    // Seed the hard negative mining of training from the pool
+    inline void set_hard_neg_pool(HardNegativePool *hard_neg_pool)
+    {
+        classifier_.set_hard_neg_pool(hard_neg_pool);
+    }
+    // Use one HOG cell grid for each scale instead of one for each window
+    inline void set_use_pyramid(bool use_pyramid)
+    {
+        use_pyramid_ = use_pyramid;
+    }
+    // Number of threads for detection, 0 for all the cores
+    inline void set_thread_num(int thread_num)
+    {
+        if (thread_num != thread_num_)
+        {
+            thread_num_ = thread_num;
+            pool_.reset();
+        }
+    }
+    // Number of windows featurized and scored at once by each thread.
+    // Peak memory of scoring is about thread_num * chunk_size * (patch
+    // + feature row) and does not depend on the image resolution.
+    inline void set_chunk_size(int chunk_size)
+    {
+        chunk_size_ = max(1, chunk_size);
+    }
+    // Reject windows with the soft cascade before the full classifier,
+    // which trades some recall for speed and is off by default
+    inline void set_use_cascade(bool use_cascade)
+    {
+        use_cascade_ = use_cascade;
+    }
+    // Recall of positives kept by the cascade, used when training
+    inline void set_cascade_recall(float cascade_recall)
+    {
+        cascade_recall_ = cascade_recall;
+    }
+    // Merge detections by greedy NMS instead of grouping with MergeRects
+    inline void set_use_nms(bool use_nms)
+    {
+        use_nms_ = use_nms;
+    }
+    // Only scan windows covered by the proposal regions, or only score
+    // the candidate windows for MSER
+    void set_proposal_type(ProposalType proposal_type);
+    // Discard flat windows by variance and edge energy before HOG, which
+    // may drop some positives and is off by default
+    inline void set_use_filter(bool use_filter)
+    {
+        use_filter_ = use_filter;
+    }
 
 private:
+    // One scale of one image to search
+    struct DetectLevel
+    {
+        size_t image_idx;
+        int size;
+        float scale;  // scale of the HOG grid in pyramid mode
+        int step;  // step of windows, in pixels or in cells
+        int col_num;  // number of window positions
+        int row_num;
+        Mat grid;
+        const Mat *integral;  // of the proposal regions, null for none
+        const FilterIntegral *filter;  // null for no prefilter
+    };
+    // A band of window rows in one level
+    struct DetectTask
+    {
+        size_t level_idx;
+        int row_begin;
+        int row_end;
+    };
+    struct DetectResult
+    {
+        vector<Rect> rects;
+        vector<int> labels;
+        vector<float> probs;
+        int win_num;
+        vector<int> reject_num;  // windows rejected at each cascade stage
+        int skip_num;  // windows skipped by the proposals
+        int filter_num;  // windows discarded by the prefilter
+    };
+    // Buffers reused by all the chunks of one thread
+    struct ChunkBuffer
+    {
+        vector<Rect> rects;
+        vector<Point> cells;
+        vector<Mat> patches;
+        Mat feats;
+        vector<int> labels;
+        vector<float> probs;
+    };
+
     HogSignClassifier classifier_;
     Size image_size_;
     float th_;
+    bool use_pyramid_;
+    int thread_num_;
+    int chunk_size_;
+    std::unique_ptr<ThreadPool> pool_;
+    SoftCascade cascade_;
+    bool use_cascade_;
+    float cascade_recall_;
+    vector<size_t> cascade_reject_;  // accumulated by Detect
+    bool use_nms_;
+    ProposalType proposal_type_;
+    std::unique_ptr<Proposal> proposal_;
+    size_t proposal_skip_;  // accumulated by Detect
+    WindowFilter filter_;
+    bool use_filter_;
+    size_t filter_skip_;  // accumulated by Detect
+
+    ThreadPool& pool();
+    bool PrepareLevel(const Mat &gray, DetectLevel *level) const;
+    void PrepareBuffer(bool use_patch, ChunkBuffer *buffer) const;
+    void AddResultStat(const DetectResult &result);
+    bool DetectCandidates(const vector<Mat> &images,
+            vector<vector<Rect>> *rects, vector<vector<int>> *labels,
+            vector<vector<float>> *probs, int *win_num, bool is_merge);
+    int GetFullWindowNum(const Size &size) const;
+    bool CountProposed(const Mat &image, const vector<Rect> &truth,
+            size_t *proposed_num) const;
+    void Merge(vector<Rect> &rects, vector<int> &labels,
+            vector<float> &probs) const;
+    bool DetectBand(const Mat &gray, const DetectLevel &level,
+            int row_begin, int row_end, ChunkBuffer *buffer,
+            DetectResult *result) const;
+    bool ScoreChunk(const Mat &gray, const DetectLevel &level,
+            ChunkBuffer *buffer, DetectResult *result) const;
 };
 }  // namespace ghk
 
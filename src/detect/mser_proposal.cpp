@@ -0,0 +1,124 @@
+/*************************************************************************
+    > File Name: src/detect/mser_proposal.cpp
+    > Author: Guo Hengkai
+    > Description: MSER region proposal class implementation
+    > Created Time: Wed 24 Jun 2015 04:02:51 PM CST
+ ************************************************************************/
+#include "mser_proposal.h"
+#include <algorithm>
+#include <cmath>
+extern "C"
+{
+#include "mser.h"
+}
+
+namespace ghk
+{
+bool RectLessThan(const Rect &lhs, const Rect &rhs)
+{
+    if (lhs.x != rhs.x) return lhs.x < rhs.x;
+    if (lhs.y != rhs.y) return lhs.y < rhs.y;
+    return lhs.width < rhs.width;
+}
+
+bool RectEqual(const Rect &lhs, const Rect &rhs)
+{
+    return lhs.x == rhs.x && lhs.y == rhs.y && lhs.width == rhs.width;
+}
+
+bool MserProposal::GetRegions(const Mat &image, vector<Rect> *regions) const
+{
+    if (regions == nullptr || image.empty())
+    {
+        return false;
+    }
+    regions->clear();
+
+    Mat gray;
+    if (image.channels() == 3)
+    {
+        cvtColor(image, gray, CV_BGR2GRAY);
+    }
+    else
+    {
+        gray = image.clone();
+    }
+
+    // Column-major for vlfeat, so the first dimension is x
+    int dims[2] = {gray.cols, gray.rows};
+    VlMserFilt *filt = vl_mser_new(2, dims);
+    if (filt == nullptr)
+    {
+        printf("Fail to create the MSER filter.\n");
+        return false;
+    }
+    float area = static_cast<float>(gray.cols) * gray.rows;
+    float min_side = SIZE_LIST.front() * 0.5f;
+    float max_side = SIZE_LIST.back() * 1.5f;
+    vl_mser_set_delta(filt, MSER_DELTA);
+    vl_mser_set_min_area(filt, min(1.0f, min_side * min_side / 4 / area));
+    vl_mser_set_max_area(filt, min(1.0f, max_side * max_side / area));
+    vl_mser_set_max_variation(filt, MSER_MAX_VARIATION);
+    vl_mser_set_min_diversity(filt, MSER_MIN_DIVERSITY);
+
+    // Dark regions on bright background and the inverse
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        if (pass == 1)
+        {
+            gray = 255 - gray;
+        }
+        vl_mser_process(filt, gray.ptr<vl_mser_pix>());
+        vl_mser_ell_fit(filt);
+        int ell_num = vl_mser_get_ell_num(filt);
+        int dof = vl_mser_get_ell_dof(filt);
+        const float *ell = vl_mser_get_ell(filt);
+        for (int i = 0; i < ell_num; ++i, ell += dof)
+        {
+            // The box covers twice of the standard deviation
+            float side = 4 * sqrt(max(ell[2], ell[4]));
+            if (side >= min_side && side <= max_side)
+            {
+                AddCandidates(ell[0], ell[1], side, gray.size(), regions);
+            }
+        }
+    }
+    vl_mser_delete(filt);
+
+    // Nested regions give the same boxes
+    sort(regions->begin(), regions->end(), RectLessThan);
+    regions->erase(std::unique(regions->begin(), regions->end(), RectEqual),
+            regions->end());
+    return true;
+}
+
+void MserProposal::AddCandidates(float cx, float cy, float side,
+        const Size &size, vector<Rect> *regions) const
+{
+    // The nearest box size in the log scale
+    int box_size = SIZE_LIST.front();
+    for (auto s: SIZE_LIST)
+    {
+        if (fabs(log(side / s)) < fabs(log(side / box_size)))
+        {
+            box_size = s;
+        }
+    }
+
+    // Snap to the neighboring positions of the sliding window grid
+    float x = (cx - box_size * 0.5f) / DETECT_STEP;
+    float y = (cy - box_size * 0.5f) / DETECT_STEP;
+    int max_x = size.width - box_size - 1;
+    int max_y = size.height - box_size - 1;
+    for (int gx = cvFloor(x); gx <= cvCeil(x); ++gx)
+        for (int gy = cvFloor(y); gy <= cvCeil(y); ++gy)
+        {
+            int px = gx * DETECT_STEP;
+            int py = gy * DETECT_STEP;
+            if (px >= 0 && py >= 0 && px <= max_x && py <= max_y)
+            {
+                regions->push_back(Rect(px, py, box_size, box_size));
+            }
+        }
+}
+}  // namespace ghk
@@ -0,0 +1,37 @@
+/*************************************************************************
+    > File Name: src/detect/mser_proposal.h
+    > Author: Guo Hengkai
+    > Description: MSER region proposal class definition
+    > Created Time: Wed 24 Jun 2015 03:40:22 PM CST
+ ************************************************************************/
+#ifndef FINAL_MSER_PROPOSAL_H_
+#define FINAL_MSER_PROPOSAL_H_
+
+#include "common.h"
+#include "dataset.h"
+#include "proposal.h"
+
+namespace ghk
+{
+const int MSER_DELTA = 5;
+const float MSER_MAX_VARIATION = 0.25f;
+const float MSER_MIN_DIVERSITY = 0.2f;
+
+// Candidate windows fitted to the maximally stable extremal regions of
+// both the gray and the inverted gray image. Each region is fitted with
+// an ellipse, and a square box is snapped to the sizes of SIZE_LIST and
+// to the grid of DETECT_STEP.
+class MserProposal: public Proposal
+{
+public:
+    MserProposal() {}
+
+    virtual bool GetRegions(const Mat &image, vector<Rect> *regions) const;
+
+private:
+    void AddCandidates(float cx, float cy, float side, const Size &size,
+            vector<Rect> *regions) const;
+};
+}  // namespace ghk
+
+#endif  // FINAL_MSER_PROPOSAL_H_
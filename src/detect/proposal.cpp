@@ -0,0 +1,51 @@
+/*************************************************************************
+    > File Name: src/detect/proposal.cpp
+    > Author: Guo Hengkai
+    > Description: Base region proposal class implementation
+    > Created Time: Tue 23 Jun 2015 09:30:08 AM CST
+ ************************************************************************/
+#include "proposal.h"
+
+namespace ghk
+{
+bool Proposal::GetIntegral(const Mat &image, Mat *integral) const
+{
+    vector<Rect> regions;
+    if (!GetRegions(image, &regions))
+    {
+        return false;
+    }
+
+    // Signs are often only partly colored, so enlarge the regions
+    Rect image_rect(0, 0, image.cols, image.rows);
+    Mat mask = Mat::zeros(image.rows, image.cols, CV_8U);
+    for (auto &region: regions)
+    {
+        int dx = cvRound(region.width * PROPOSAL_EXPAND_RATE);
+        int dy = cvRound(region.height * PROPOSAL_EXPAND_RATE);
+        Rect rect = Rect(region.x - dx, region.y - dy,
+                region.width + 2 * dx, region.height + 2 * dy) & image_rect;
+        if (rect.area() > 0)
+        {
+            mask(rect).setTo(cv::Scalar(1));
+        }
+    }
+    cv::integral(mask, *integral, CV_32S);
+    return true;
+}
+
+bool IsProposed(const Mat &integral, const Rect &window)
+{
+    if (integral.empty())
+    {
+        return true;
+    }
+    int x1 = max(0, min(window.x, integral.cols - 1));
+    int y1 = max(0, min(window.y, integral.rows - 1));
+    int x2 = max(0, min(window.x + window.width, integral.cols - 1));
+    int y2 = max(0, min(window.y + window.height, integral.rows - 1));
+    int covered = integral.at<int>(y2, x2) - integral.at<int>(y1, x2)
+        - integral.at<int>(y2, x1) + integral.at<int>(y1, x1);
+    return covered >= PROPOSAL_COVER_RATE * window.area();
+}
+}  // namespace ghk
@@ -0,0 +1,41 @@
+/*************************************************************************
+    > File Name: src/detect/proposal.h
+    > Author: Guo Hengkai
+    > Description: Base region proposal class definition
+    > Created Time: Tue 23 Jun 2015 09:12:35 AM CST
+ ************************************************************************/
+#ifndef FINAL_PROPOSAL_H_
+#define FINAL_PROPOSAL_H_
+
+#include "common.h"
+
+namespace ghk
+{
+enum ProposalType
+{
+    PROPOSAL_NONE = 0,
+    PROPOSAL_COLOR,  // scan windows covered by the regions
+    PROPOSAL_MSER  // only score the regions as candidate windows
+};
+
+const float PROPOSAL_COVER_RATE = 0.1f;  // min covered area of a window
+const float PROPOSAL_EXPAND_RATE = 0.25f;  // expansion of each region box
+
+class Proposal
+{
+public:
+    virtual ~Proposal() {}
+
+    // Bounding boxes of the candidate regions in a BGR image
+    virtual bool GetRegions(const Mat &image,
+            vector<Rect> *regions) const = 0;
+    // Integral image of the mask of the expanded region boxes
+    bool GetIntegral(const Mat &image, Mat *integral) const;
+};
+
+// Whether the window is covered enough by the regions of the integral,
+// every window is proposed for an empty integral
+bool IsProposed(const Mat &integral, const Rect &window);
+}  // namespace ghk
+
+#endif  // FINAL_PROPOSAL_H_
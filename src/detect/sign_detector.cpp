@@ -5,6 +5,8 @@
     > Created Time: Wed 17 Jun 2015 10:17:12 AM CST
  ************************************************************************/
 #include "sign_detector.h"
+#include <algorithm>
+#include <climits>
 
 namespace ghk
 {
@@ -43,8 +45,260 @@ int FindFather(vector<int> &father, int x)
     return father[x];
 }
 
+// Iterative version with path halving, safe for long chains
+int FindRoot(vector<int> &father, int x)
+{
+    while (father[x] != x)
+    {
+        father[x] = father[father[x]];
+        x = father[x];
+    }
+    return x;
+}
+
+bool IsMergeable(const Rect &lhs, const Rect &rhs, float hit_rate)
+{
+    return static_cast<float>((lhs & rhs).area())
+        / ((lhs | rhs).area()) >= hit_rate;
+}
+
+bool IsConflict(const Rect &lhs, const Rect &rhs)
+{
+    return (lhs & rhs).area() * 2 > min(lhs.area(), rhs.area());
+}
+
+// Boxes bucketed by label and by the cell of their centers. Two boxes
+// closer than cell_size in both center coordinates are always in
+// neighboring cells.
+class RectGrid
+{
+public:
+    RectGrid(const vector<Rect> &rects, const vector<int> &labels,
+            int cell_size): cell_size_(max(1, cell_size))
+    {
+        keys_.resize(rects.size());
+        for (size_t i = 0; i < rects.size(); ++i)
+        {
+            // Use doubled centers to stay in integers
+            keys_[i].label = labels[i];
+            keys_[i].gx = cvFloor((2.0 * rects[i].x + rects[i].width)
+                    / (2.0 * cell_size_));
+            keys_[i].gy = cvFloor((2.0 * rects[i].y + rects[i].height)
+                    / (2.0 * cell_size_));
+            keys_[i].idx = static_cast<int>(i);
+        }
+        entries_ = keys_;
+        std::sort(entries_.begin(), entries_.end());
+    }
+
+    // Indices of boxes with the same label in the 3x3 neighboring cells
+    void GetNeighbors(size_t idx, vector<int> *neighbors) const
+    {
+        neighbors->clear();
+        const GridKey &key = keys_[idx];
+        for (int dx = -1; dx <= 1; ++dx)
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                GridKey cell{key.label, key.gx + dx, key.gy + dy, INT_MIN};
+                for (auto iter = std::lower_bound(entries_.begin(),
+                            entries_.end(), cell); iter != entries_.end()
+                        && iter->label == cell.label && iter->gx == cell.gx
+                        && iter->gy == cell.gy; ++iter)
+                {
+                    neighbors->push_back(iter->idx);
+                }
+            }
+    }
+
+private:
+    struct GridKey
+    {
+        int label;
+        int gx;
+        int gy;
+        int idx;
+
+        bool operator<(const GridKey &rhs) const
+        {
+            if (label != rhs.label) return label < rhs.label;
+            if (gx != rhs.gx) return gx < rhs.gx;
+            if (gy != rhs.gy) return gy < rhs.gy;
+            return idx < rhs.idx;
+        }
+    };
+
+    int cell_size_;
+    vector<GridKey> keys_;  // in the order of boxes
+    vector<GridKey> entries_;  // sorted by cells
+};
+
+int GetMaxSide(const vector<Rect> &rects)
+{
+    int max_side = 0;
+    for (auto &rect: rects)
+    {
+        max_side = max(max_side, max(rect.width, rect.height));
+    }
+    return max_side;
+}
+
 void MergeRects(vector<Rect> &rects, vector<int> &labels,
         vector<float> &probs, float hit_rate)
+{
+    // The grid bound needs overlapping boxes
+    if (hit_rate <= 0)
+    {
+        MergeRectsBruteForce(rects, labels, probs, hit_rate);
+        return;
+    }
+
+    // Mergeable boxes overlap by hit_rate of their bounding box in each
+    // axis, so their centers are less than (1 - hit_rate) * max_side apart
+    int n = static_cast<int>(rects.size());
+    int cell_size = static_cast<int>((1 - hit_rate) * GetMaxSide(rects)) + 1;
+    RectGrid grid(rects, labels, cell_size);
+
+    // Create Union-Find Set for boxes
+    vector<int> father(n);
+    for (int i = 0; i < n; ++i)
+    {
+        father[i] = i;
+    }
+    vector<int> neighbors;
+    for (int i = 0; i < n; ++i)
+    {
+        grid.GetNeighbors(i, &neighbors);
+        for (auto j: neighbors)
+        {
+            if (j > i && FindRoot(father, i) != FindRoot(father, j)
+                    && IsMergeable(rects[i], rects[j], hit_rate))
+            {
+                father[FindRoot(father, i)] = FindRoot(father, j);
+            }
+        }
+    }
+
+    // Merge boxes in the same set in one pass
+    vector<Rect> sums(n, Rect(0, 0, 0, 0));
+    vector<float> scores(n, -1000000.0f);
+    vector<int> counts(n, 0);
+    for (int j = 0; j < n; ++j)
+    {
+        int i = FindRoot(father, j);
+        sums[i].x += rects[j].x;
+        sums[i].y += rects[j].y;
+        sums[i].width += rects[j].width;
+        sums[i].height += rects[j].height;
+        if (probs[j] > scores[i])
+        {
+            scores[i] = probs[j];
+        }
+        ++counts[i];
+    }
+    vector<Rect> rrects;
+    vector<int> rlabels;
+    vector<float> rprobs;
+    for (int i = 0; i < n; ++i)
+    {
+        int k = counts[i];
+        if (k <= 1)
+        {
+            continue;
+        }
+
+        Rect sum = sums[i];
+        float ik = 1.0f / k;
+        sum.x = static_cast<int>(sum.x * ik + 0.5);
+        sum.y = static_cast<int>(sum.y * ik + 0.5);
+        sum.width = static_cast<int>(sum.width * ik + 0.5);
+        sum.height = static_cast<int>(sum.height * ik + 0.5);
+        rrects.push_back(sum);
+        rprobs.push_back(scores[i]);
+        rlabels.push_back(labels[i]);
+    }
+
+    // Deal with conflict boxes using non-maximum suppression, conflict
+    // boxes intersect so their centers are less than max_side apart
+    rects.clear();
+    labels.clear();
+    probs.clear();
+    n = static_cast<int>(rrects.size());
+    RectGrid merged_grid(rrects, rlabels, GetMaxSide(rrects) + 1);
+    for (int i = 0; i < n; ++i)
+    {
+        bool flag = true;
+        merged_grid.GetNeighbors(i, &neighbors);
+        for (auto j: neighbors)
+        {
+            if (j != i && rprobs[j] > rprobs[i]
+                    && IsConflict(rrects[i], rrects[j]))
+            {
+                flag = false;
+                break;
+            }
+        }
+        if (flag)
+        {
+            rects.push_back(rrects[i]);
+            labels.push_back(rlabels[i]);
+            probs.push_back(rprobs[i]);
+        }
+    }
+}
+
+void SuppressRects(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs, float overlap)
+{
+    int n = static_cast<int>(rects.size());
+    vector<DetectedRect> order(n);
+    for (int i = 0; i < n; ++i)
+    {
+        order[i].prob = probs[i];
+        order[i].idx = i;
+    }
+    std::stable_sort(order.begin(), order.end(), DetectedRectComp);
+
+    // Boxes with positive IoU intersect, so the grid bound holds
+    RectGrid grid(rects, labels, GetMaxSide(rects) + 1);
+    vector<bool> is_kept(n, false);
+    vector<int> neighbors;
+    vector<Rect> rrects;
+    vector<int> rlabels;
+    vector<float> rprobs;
+    for (auto &item: order)
+    {
+        int i = static_cast<int>(item.idx);
+        bool flag = true;
+        grid.GetNeighbors(i, &neighbors);
+        for (auto j: neighbors)
+        {
+            if (!is_kept[j])
+            {
+                continue;
+            }
+            int inter = (rects[i] & rects[j]).area();
+            if (static_cast<float>(inter) / (rects[i].area()
+                        + rects[j].area() - inter) > overlap)
+            {
+                flag = false;
+                break;
+            }
+        }
+        if (flag)
+        {
+            is_kept[i] = true;
+            rrects.push_back(rects[i]);
+            rlabels.push_back(labels[i]);
+            rprobs.push_back(probs[i]);
+        }
+    }
+    rects.swap(rrects);
+    labels.swap(rlabels);
+    probs.swap(rprobs);
+}
+
+void MergeRectsBruteForce(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs, float hit_rate)
 {
     // Create Union-Find Set for boxes
     vector<int> father;
@@ -59,8 +313,7 @@ void MergeRects(vector<Rect> &rects, vector<int> &labels,
             if (FindFather(father, i) != FindFather(father, j))
             {
                 if (labels[i] == labels[j] &&
-                        static_cast<float>((rects[i] & rects[j]).area())
-                         / ((rects[i] | rects[j]).area()) >= hit_rate)
+                        IsMergeable(rects[i], rects[j], hit_rate))
                 {
                     father[FindFather(father, i)] = FindFather(father, j);
                 }
@@ -123,8 +376,7 @@ void MergeRects(vector<Rect> &rects, vector<int> &labels,
         {
             if (j != i && rlabels[j] == rlabels[i] && rprobs[j] > rprobs[i])
             {
-                if ((rrects[i] & rrects[j]).area() * 2
-                        > min(rrects[i].area(), rrects[j].area()))
+                if (IsConflict(rrects[i], rrects[j]))
                 {
                     flag = false;
                     break;
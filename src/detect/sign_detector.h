@@ -28,8 +28,18 @@ public:
             vector<Rect> *rects, vector<int> *labels);
 };
 
+// Merge groups of boxes with the same label whose intersection over
+// bounding box is at least hit_rate, and drop conflict merged boxes.
+// Candidate pairs are found with a grid over the box centers.
 void MergeRects(vector<Rect> &rects, vector<int> &labels,
         vector<float> &probs, float hit_rate);
+// Reference all-pairs version of MergeRects with the same result
+void MergeRectsBruteForce(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs, float hit_rate);
+// Greedy non-maximum suppression in the descending order of probs, a box
+// is removed if its IoU with a kept box of the same label exceeds overlap
+void SuppressRects(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs, float overlap);
 }  // namespace ghk
 
 #endif  // FINAL_SIGN_DETECTOR_H_
@@ -0,0 +1,165 @@
+/*************************************************************************
+    > File Name: src/detect/soft_cascade.cpp
+    > Author: Guo Hengkai
+    > Description: Soft cascade class implementation for early rejection of windows
+    > Created Time: Tue 07 Jul 2015 10:48:03 AM CST
+ ************************************************************************/
+#include "soft_cascade.h"
+#include "file_util.h"
+#include "svm_classifier.h"
+
+namespace ghk
+{
+bool SoftCascade::Save(const string &model_name) const
+{
+    vector<float> param{static_cast<float>(win_cells_),
+                        static_cast<float>(dim_), bias_};
+    param.insert(param.end(), thresholds_.begin(), thresholds_.end());
+    return SaveMat(model_name, weights_, param);
+}
+
+bool SoftCascade::Load(const string &model_name)
+{
+    vector<float> param;
+    if (!LoadMat(model_name, &weights_, &param) || param.size() < 3)
+    {
+        weights_ = Mat();
+        return false;
+    }
+    win_cells_ = static_cast<int>(param[0]);
+    dim_ = static_cast<int>(param[1]);
+    bias_ = param[2];
+    thresholds_.assign(param.begin() + 3, param.end());
+    BuildStages();
+    return true;
+}
+
+bool SoftCascade::Train(const Mat &feats, const vector<int> &labels,
+        int win_cells, int dim, float recall)
+{
+    win_cells_ = win_cells;
+    dim_ = dim;
+    weights_ = Mat();
+    thresholds_.clear();
+    if (feats.cols != win_cells * win_cells * dim)
+    {
+        return false;
+    }
+
+    // Train linear sign-vs-background model
+    vector<int> bin_labels;
+    for (auto label: labels)
+    {
+        bin_labels.push_back(label > 0 ? 1 : 0);
+    }
+    SvmClassifier classifier;
+    if (!classifier.Train(feats, bin_labels))
+    {
+        return false;
+    }
+    Mat weights, bias;
+    vector<int> svm_labels;
+    if (!classifier.GetLinearWeights(&weights, &bias, &svm_labels))
+    {
+        return false;
+    }
+    weights_ = weights.row(0).clone();
+    bias_ = bias.at<float>(0, 0);
+    if (svm_labels[0] == 0)  // Make the score positive for signs
+    {
+        weights_ *= -1;
+        bias_ = -bias_;
+    }
+    thresholds_.assign(CASCADE_STAGE_NUM, -FLT_MAX);
+    BuildStages();
+
+    // Learn the rejection thresholds so that each stage drops an equal
+    // share of the positives allowed to be missed
+    vector<int> pos_idx;
+    for (size_t i = 0; i < labels.size(); ++i)
+    {
+        if (labels[i] > 0)
+        {
+            pos_idx.push_back(static_cast<int>(i));
+        }
+    }
+    int miss_num = static_cast<int>((1 - recall) * pos_idx.size()
+            / CASCADE_STAGE_NUM);
+    vector<float> scores(pos_idx.size(), bias_);
+    vector<bool> is_rejected(pos_idx.size(), false);
+    const float *w = weights_.ptr<float>(0);
+    for (int t = 0; t < CASCADE_STAGE_NUM; ++t)
+    {
+        vector<float> stage_scores;
+        for (size_t i = 0; i < pos_idx.size(); ++i)
+        {
+            if (is_rejected[i])
+            {
+                continue;
+            }
+            const float *feat = feats.ptr<float>(pos_idx[i]);
+            for (auto start: stage_runs_[t])
+            {
+                for (int k = start; k < start + win_cells_; ++k)
+                {
+                    scores[i] += w[k] * feat[k];
+                }
+            }
+            stage_scores.push_back(scores[i]);
+        }
+        if (static_cast<int>(stage_scores.size()) <= miss_num)
+        {
+            continue;
+        }
+        std::nth_element(stage_scores.begin(),
+                stage_scores.begin() + miss_num, stage_scores.end());
+        thresholds_[t] = stage_scores[miss_num];
+        for (size_t i = 0; i < pos_idx.size(); ++i)
+        {
+            if (scores[i] < thresholds_[t])
+            {
+                is_rejected[i] = true;
+            }
+        }
+    }
+    return true;
+}
+
+int SoftCascade::Evaluate(const float *feat) const
+{
+    const float *w = weights_.ptr<float>(0);
+    float score = bias_;
+    for (int t = 0; t < stage_num(); ++t)
+    {
+        for (auto start: stage_runs_[t])
+        {
+            for (int k = start; k < start + win_cells_; ++k)
+            {
+                score += w[k] * feat[k];
+            }
+        }
+        if (score < thresholds_[t])
+        {
+            return t;
+        }
+    }
+    return stage_num();
+}
+
+void SoftCascade::BuildStages()
+{
+    // Stage t covers a band of cell rows over all the feature planes
+    int num = stage_num();
+    stage_runs_.assign(num, vector<int>());
+    for (int t = 0; t < num; ++t)
+    {
+        int row_begin = win_cells_ * t / num;
+        int row_end = win_cells_ * (t + 1) / num;
+        for (int k = 0; k < dim_; ++k)
+            for (int y = row_begin; y < row_end; ++y)
+            {
+                stage_runs_[t].push_back((k * win_cells_ + y) * win_cells_);
+            }
+    }
+}
+}  // namespace ghk
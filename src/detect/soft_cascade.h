@@ -0,0 +1,51 @@
+/*************************************************************************
+    > File Name: src/detect/soft_cascade.h
+    > Author: Guo Hengkai
+    > Description: Soft cascade class definition for early rejection of windows
+    > Created Time: Tue 07 Jul 2015 10:21:36 AM CST
+ ************************************************************************/
+#ifndef FINAL_SOFT_CASCADE_H_
+#define FINAL_SOFT_CASCADE_H_
+
+#include "common.h"
+
+namespace ghk
+{
+const int CASCADE_STAGE_NUM = 4;
+const float CASCADE_RECALL = 0.99f;  // positives kept by the whole cascade
+
+// Linear sign-vs-background model on HOG window features. Stage t adds
+// the score of one band of cell rows and rejects the window if the
+// cumulative score falls below the threshold of the stage.
+class SoftCascade
+{
+public:
+    SoftCascade(): win_cells_(0), dim_(0), bias_(0) {}
+
+    bool Save(const string &model_name) const;
+    bool Load(const string &model_name);
+
+    bool Train(const Mat &feats, const vector<int> &labels,
+            int win_cells, int dim, float recall = CASCADE_RECALL);
+    // Return the stage rejecting the feature, or stage_num() if it passes
+    int Evaluate(const float *feat) const;
+
+    inline int stage_num() const
+    {
+        return static_cast<int>(thresholds_.size());
+    }
+    inline bool empty() const { return weights_.empty(); }
+
+private:
+    int win_cells_;
+    int dim_;
+    Mat weights_;  // normalization folded in
+    float bias_;
+    vector<float> thresholds_;
+    vector<vector<int>> stage_runs_;  // start of the rows of cells
+
+    void BuildStages();
+};
+}  // namespace ghk
+
+#endif  // FINAL_SOFT_CASCADE_H_
@@ -0,0 +1,159 @@
+/*************************************************************************
+    > File Name: src/detect/video_sign_detector.cpp
+    > Author: Guo Hengkai
+    > Description: Video sign detector class implementation
+    > Created Time: Mon 22 Jun 2015 02:30:12 PM CST
+ ************************************************************************/
+#include "video_sign_detector.h"
+#include <algorithm>
+#include "dataset.h"
+#include "timer.h"
+
+namespace ghk
+{
+bool VideoSignDetector::Process(const Mat &frame, vector<Rect> *rects,
+        vector<int> *labels, vector<float> *probs)
+{
+    if (detector_ == nullptr || rects == nullptr || labels == nullptr
+            || probs == nullptr)
+    {
+        return false;
+    }
+
+    if (frame_idx_ % rescan_interval_ == 0)
+    {
+        // Full scan of all the scales
+        vector<Mat> image_vec(1, frame);
+        vector<vector<Rect>> rect_vec;
+        vector<vector<int>> label_vec;
+        vector<vector<float>> prob_vec;
+        if (!detector_->Detect(image_vec, &rect_vec, &label_vec, &prob_vec))
+        {
+            return false;
+        }
+        *rects = rect_vec[0];
+        *labels = label_vec[0];
+        *probs = prob_vec[0];
+    }
+    else
+    {
+        // Only search around the previous detections
+        vector<Rect> windows;
+        GetNeighborWindows(frame.size(), &windows);
+        if (!detector_->DetectWindows(frame, windows, rects, labels, probs))
+        {
+            return false;
+        }
+    }
+
+    prev_rects_ = *rects;
+    ++frame_idx_;
+    return true;
+}
+
+bool VideoSignDetector::Run(const string &video_name, bool is_show)
+{
+    cv::VideoCapture capture(video_name);
+    if (!capture.isOpened())
+    {
+        printf("Fail to open the video %s.\n", video_name.c_str());
+        return false;
+    }
+
+    Reset();
+    vector<float> latencies;
+    Timer timer;
+    Timer total_timer;
+    total_timer.Start();
+    Mat frame;
+    while (capture.read(frame))
+    {
+        vector<Rect> rects;
+        vector<int> labels;
+        vector<float> probs;
+        timer.Start();
+        if (!Process(frame, &rects, &labels, &probs))
+        {
+            return false;
+        }
+        latencies.push_back(timer.Snapshot());
+
+        if (is_show)
+        {
+            for (auto &rect: rects)
+            {
+                cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
+            }
+            cv::imshow("video", frame);
+            cv::waitKey(1);
+        }
+    }
+    float total_time = total_timer.Snapshot();
+
+    if (latencies.empty())
+    {
+        printf("No frame in the video %s.\n", video_name.c_str());
+        return false;
+    }
+    size_t n = latencies.size();
+    float detect_time = 0;
+    for (auto latency: latencies)
+    {
+        detect_time += latency;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    printf("Total %zu frames, %0.2f FPS (%0.2f FPS of detection)\n", n,
+            n / max(total_time, 1e-6f), n / max(detect_time, 1e-6f));
+    printf("Latency of frames: p50 %0.2fms, p90 %0.2fms, p99 %0.2fms\n",
+            latencies[(n - 1) * 50 / 100] * 1000,
+            latencies[(n - 1) * 90 / 100] * 1000,
+            latencies[(n - 1) * 99 / 100] * 1000);
+
+    return true;
+}
+
+void VideoSignDetector::Reset()
+{
+    frame_idx_ = 0;
+    prev_rects_.clear();
+}
+
+void VideoSignDetector::GetNeighborWindows(const Size &frame_size,
+        vector<Rect> *windows) const
+{
+    windows->clear();
+    for (auto &rect: prev_rects_)
+    {
+        int cx = rect.x + rect.width / 2;
+        int cy = rect.y + rect.height / 2;
+        int side = max(rect.width, rect.height);
+        for (auto scale: VIDEO_SCALE_LIST)
+        {
+            int size = cvRound(side * scale);
+            if (size > frame_size.width || size > frame_size.height)
+            {
+                continue;
+            }
+            for (int dx = -VIDEO_SHIFT_NUM; dx <= VIDEO_SHIFT_NUM; ++dx)
+                for (int dy = -VIDEO_SHIFT_NUM; dy <= VIDEO_SHIFT_NUM; ++dy)
+                {
+                    // Clamp the window inside the frame
+                    int x = cx - size / 2 + dx * DETECT_STEP;
+                    int y = cy - size / 2 + dy * DETECT_STEP;
+                    x = min(max(x, 0), frame_size.width - size);
+                    y = min(max(y, 0), frame_size.height - size);
+                    windows->push_back(Rect(x, y, size, size));
+                }
+        }
+    }
+
+    // Remove the duplicated windows after clamping
+    std::sort(windows->begin(), windows->end(),
+            [](const Rect &a, const Rect &b) {
+                return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y
+                    : a.width < b.width);
+            });
+    windows->erase(std::unique(windows->begin(), windows->end()),
+            windows->end());
+}
+}  // namespace ghk
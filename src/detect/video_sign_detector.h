@@ -0,0 +1,54 @@
+/*************************************************************************
+    > File Name: src/detect/video_sign_detector.h
+    > Author: Guo Hengkai
+    > Description: Video sign detector class definition
+    > Created Time: Mon 22 Jun 2015 02:16:40 PM CST
+ ************************************************************************/
+#ifndef FINAL_VIDEO_SIGN_DETECTOR_H_
+#define FINAL_VIDEO_SIGN_DETECTOR_H_
+
+#include "common.h"
+#include "hog_sign_detector.h"
+
+namespace ghk
+{
+const int VIDEO_RESCAN_INTERVAL = 10;  // frames between full scans
+const vector<float> VIDEO_SCALE_LIST = vector<float>{0.83f, 1.0f, 1.2f};
+const int VIDEO_SHIFT_NUM = 2;  // shifts of DETECT_STEP in each direction
+
+// Detect signs in a video stream. The whole frame is scanned every
+// rescan_interval frames, and the frames between only search around the
+// merged detections of the previous frame.
+class VideoSignDetector
+{
+public:
+    explicit VideoSignDetector(HogSignDetector *detector,
+            int rescan_interval = VIDEO_RESCAN_INTERVAL):
+        detector_(detector), rescan_interval_(max(1, rescan_interval)),
+        frame_idx_(0) {}
+
+    // Detect on the next frame of the stream
+    bool Process(const Mat &frame, vector<Rect> *rects,
+            vector<int> *labels, vector<float> *probs);
+    // Detect on the whole video, and report FPS and latency of frames
+    bool Run(const string &video_name, bool is_show = false);
+    // Start a new stream, the next frame is fully scanned
+    void Reset();
+
+    inline void set_rescan_interval(int rescan_interval)
+    {
+        rescan_interval_ = max(1, rescan_interval);
+    }
+
+private:
+    HogSignDetector *detector_;
+    int rescan_interval_;
+    int frame_idx_;
+    vector<Rect> prev_rects_;
+
+    void GetNeighborWindows(const Size &frame_size,
+            vector<Rect> *windows) const;
+};
+}  // namespace ghk
+
+#endif  // FINAL_VIDEO_SIGN_DETECTOR_H_
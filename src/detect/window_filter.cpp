@@ -0,0 +1,119 @@
+/*************************************************************************
+    > File Name: src/detect/window_filter.cpp
+    > Author: Guo Hengkai
+    > Description: Window prefilter class implementation on integral images
+    > Created Time: Wed 08 Jul 2015 03:02:44 PM CST
+ ************************************************************************/
+#include "window_filter.h"
+#include <algorithm>
+#include "file_util.h"
+
+namespace ghk
+{
+bool WindowFilter::Save(const string &model_name) const
+{
+    vector<float> param{min_var_, min_edge_};
+    return SaveMat(model_name, Mat(), param);
+}
+
+bool WindowFilter::Load(const string &model_name)
+{
+    Mat mat;
+    vector<float> param;
+    if (!LoadMat(model_name, &mat, &param) || param.size() < 2)
+    {
+        is_trained_ = false;
+        return false;
+    }
+    min_var_ = param[0];
+    min_edge_ = param[1];
+    is_trained_ = true;
+    return true;
+}
+
+bool WindowFilter::Train(const vector<Mat> &images, float recall)
+{
+    is_trained_ = false;
+    if (images.empty())
+    {
+        return false;
+    }
+
+    vector<float> vars;
+    vector<float> edges;
+    for (auto &image: images)
+    {
+        Mat gray;
+        if (image.channels() == 3)
+        {
+            cvtColor(image, gray, CV_BGR2GRAY);
+        }
+        else
+        {
+            gray = image;
+        }
+        FilterIntegral integral;
+        GetIntegral(gray, &integral);
+        float var, edge;
+        GetStat(integral, Rect(0, 0, gray.cols, gray.rows), &var, &edge);
+        vars.push_back(var);
+        edges.push_back(edge);
+    }
+
+    // Low percentile of the positives
+    size_t k = static_cast<size_t>((1 - recall) * images.size());
+    std::nth_element(vars.begin(), vars.begin() + k, vars.end());
+    std::nth_element(edges.begin(), edges.begin() + k, edges.end());
+    min_var_ = vars[k];
+    min_edge_ = edges[k];
+    is_trained_ = true;
+    printf("Window filter: min variance %0.2f, min edge energy %0.2f\n",
+            min_var_, min_edge_);
+    return true;
+}
+
+void WindowFilter::GetIntegral(const Mat &gray,
+        FilterIntegral *integral) const
+{
+    cv::integral(gray, integral->sum, integral->sqsum, CV_64F);
+
+    Mat dx, dy, mag;
+    cv::Sobel(gray, dx, CV_32F, 1, 0);
+    cv::Sobel(gray, dy, CV_32F, 0, 1);
+    cv::magnitude(dx, dy, mag);
+    cv::integral(mag, integral->edge, CV_64F);
+}
+
+bool WindowFilter::Accept(const FilterIntegral &integral,
+        const Rect &window) const
+{
+    if (!is_trained_)
+    {
+        return true;
+    }
+    float var, edge;
+    GetStat(integral, window, &var, &edge);
+    return var >= min_var_ && edge >= min_edge_;
+}
+
+double RectSum(const Mat &integral, const Rect &rect)
+{
+    int x1 = rect.x;
+    int y1 = rect.y;
+    int x2 = rect.x + rect.width;
+    int y2 = rect.y + rect.height;
+    return integral.at<double>(y2, x2) - integral.at<double>(y1, x2)
+        - integral.at<double>(y2, x1) + integral.at<double>(y1, x1);
+}
+
+void WindowFilter::GetStat(const FilterIntegral &integral,
+        const Rect &window, float *var, float *edge) const
+{
+    double area = max(window.area(), 1);
+    double mean = RectSum(integral.sum, window) / area;
+    *var = static_cast<float>(RectSum(integral.sqsum, window) / area
+            - mean * mean);
+    *edge = static_cast<float>(RectSum(integral.edge, window)
+            / max(1, max(window.width, window.height)));
+}
+}  // namespace ghk
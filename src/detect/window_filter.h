@@ -0,0 +1,54 @@
+/*************************************************************************
+    > File Name: src/detect/window_filter.h
+    > Author: Guo Hengkai
+    > Description: Window prefilter class definition on integral images
+    > Created Time: Wed 08 Jul 2015 02:35:10 PM CST
+ ************************************************************************/
+#ifndef FINAL_WINDOW_FILTER_H_
+#define FINAL_WINDOW_FILTER_H_
+
+#include "common.h"
+
+namespace ghk
+{
+const float FILTER_RECALL = 0.99f;  // positives kept by each threshold
+
+// Integral images of one gray frame
+struct FilterIntegral
+{
+    Mat sum;  // intensity
+    Mat sqsum;  // squared intensity
+    Mat edge;  // gradient magnitude
+};
+
+// Reject flat windows by the intensity variance and the edge energy,
+// which is the sum of gradient magnitude divided by the window side.
+// Both are computed in O(1) for each window with integral images.
+class WindowFilter
+{
+public:
+    WindowFilter(): min_var_(0), min_edge_(0), is_trained_(false) {}
+
+    bool Save(const string &model_name) const;
+    bool Load(const string &model_name);
+
+    // Learn the thresholds from the positive crops
+    bool Train(const vector<Mat> &images, float recall = FILTER_RECALL);
+    void GetIntegral(const Mat &gray, FilterIntegral *integral) const;
+    bool Accept(const FilterIntegral &integral, const Rect &window) const;
+
+    inline bool empty() const { return !is_trained_; }
+    inline float min_var() const { return min_var_; }
+    inline float min_edge() const { return min_edge_; }
+
+private:
+    float min_var_;
+    float min_edge_;
+    bool is_trained_;
+
+    void GetStat(const FilterIntegral &integral, const Rect &window,
+            float *var, float *edge) const;
+};
+}  // namespace ghk
+
+#endif  // FINAL_WINDOW_FILTER_H_
@@ -10,7 +10,7 @@
 
 namespace ghk
 {
-EigenExtractor::EigenExtractor(int feat_dim)
+EigenExtractor::EigenExtractor(int feat_dim): proj_key_(0)
 {
     set_feat_dim(feat_dim);
 }
@@ -41,6 +41,7 @@ bool EigenExtractor::Load(const string &model_name)
     {
         return false;
     }
+    UpdateProjKey();
     return true;
 }
 
@@ -65,6 +66,7 @@ bool EigenExtractor::Train(const vector<Mat> &images,
     {
         set_feat_dim(image_vecs.cols);
     }
+    UpdateProjKey();
     printf("Done!\n");
     return true;
 }
@@ -91,4 +93,20 @@ bool EigenExtractor::Extract(const vector<Mat> &images, Mat *feats)
             mean_, image_vecs);
     return true;
 }
+
+uint64_t EigenExtractor::GetParamKey() const
+{
+    if (proj_key_ == 0)
+    {
+        return 0;
+    }
+    int32_t dim = feat_dim();
+    return HashBytes(&dim, sizeof(dim), proj_key_);
+}
+
+void EigenExtractor::UpdateProjKey()
+{
+    proj_key_ = HashImage(mean_, HashImage(eigen_vector_,
+                HashBytes("eigen", 5)));
+}
 }  // namespace ghk
@@ -23,10 +23,14 @@ public:
     virtual bool Train(const vector<Mat> &images,
                 const vector<int> &labels);
     virtual bool Extract(const vector<Mat> &images, Mat *feats);
+    virtual uint64_t GetParamKey() const;
 
 private:
     Mat eigen_vector_;
     Mat mean_;
+    uint64_t proj_key_;  // Version of the projection for feature cache
+
+    void UpdateProjKey();
 };
 }  // namespace ghk
 
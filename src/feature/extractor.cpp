@@ -13,4 +13,80 @@ bool Extractor::ExtractFeat(const Mat &image, Mat *feat)
     vector<Mat> image_vec(1, image);
     return Extract(image_vec, feat);
 }
+
+bool Extractor::ExtractCached(const vector<Mat> &images, Mat *feats,
+        size_t cached_num)
+{
+    uint64_t param_key = GetParamKey();
+    cached_num = min(cached_num, images.size());
+    if (cache_ == nullptr || param_key == 0 || cached_num == 0)
+    {
+        return Extract(images, feats);
+    }
+    if (feats == nullptr)
+    {
+        return false;
+    }
+
+    // Only extract the images which are not in the cache
+    vector<uint64_t> keys(images.size());
+    vector<Mat> miss_images;
+    vector<size_t> miss_idx;
+    int dim = 0;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        if (i >= cached_num)
+        {
+            miss_images.push_back(images[i]);
+            miss_idx.push_back(i);
+            continue;
+        }
+        keys[i] = HashImage(images[i], param_key);
+        int key_dim = cache_->GetDim(keys[i]);
+        if (key_dim == 0)
+        {
+            miss_images.push_back(images[i]);
+            miss_idx.push_back(i);
+        }
+        else
+        {
+            dim = key_dim;
+        }
+    }
+    Mat miss_feats;
+    if (!miss_images.empty())
+    {
+        if (!Extract(miss_images, &miss_feats))
+        {
+            return false;
+        }
+        dim = miss_feats.cols;
+    }
+
+    Mat result(static_cast<int>(images.size()), dim, CV_32F);
+    vector<bool> is_filled(images.size(), false);
+    for (size_t i = 0; i < miss_idx.size(); ++i)
+    {
+        const float *row = miss_feats.ptr<float>(static_cast<int>(i));
+        memcpy(result.ptr<float>(static_cast<int>(miss_idx[i])), row,
+                dim * sizeof(float));
+        if (miss_idx[i] < cached_num)
+        {
+            cache_->Put(keys[miss_idx[i]], row, dim);
+        }
+        is_filled[miss_idx[i]] = true;
+    }
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        if (!is_filled[i] && !cache_->Get(keys[i], dim,
+                    result.ptr<float>(static_cast<int>(i))))
+        {
+            // Rows of another dimension, just extract all of them
+            return Extract(images, feats);
+        }
+    }
+    *feats = result;
+    set_feat_dim(dim);
+    return true;
+}
 }  // namespace ghk
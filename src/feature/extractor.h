@@ -8,12 +8,16 @@
 #define FINAL_EXTRACTOR_H_
 
 #include "common.h"
+#include "feature_cache.h"
 
 namespace ghk
 {
 class Extractor
 {
 public:
+    Extractor(): feat_dim_(0), cache_(nullptr) {}
+    virtual ~Extractor() {}
+
     virtual bool Save(const string &model_name) const { return false; }
     virtual bool Load(const string &model_name) { return false; }
 
@@ -21,12 +25,23 @@ public:
                 const vector<int> &labels) { return false; }
     virtual bool Extract(const vector<Mat> &images, Mat *feats) = 0;
     bool ExtractFeat(const Mat &image, Mat *feat);
+    // Same as Extract, but the rows of the images seen before are taken
+    // from the feature cache when it is set. Only the first cached_num
+    // images are cached, the rest such as random negatives are extracted.
+    bool ExtractCached(const vector<Mat> &images, Mat *feats,
+            size_t cached_num = SIZE_MAX);
+    // Hash of all the parameters the features depend on besides the
+    // image, 0 if the features should not be cached
+    virtual uint64_t GetParamKey() const { return 0; }
+
+    inline void set_feature_cache(FeatureCache *cache) { cache_ = cache; }
 
     inline int feat_dim() const { return feat_dim_; }
     inline void set_feat_dim(int feat_dim) { feat_dim_ = feat_dim; }
 
 private:
     int feat_dim_;
+    FeatureCache *cache_;
 };
 }  // namespace ghk
 
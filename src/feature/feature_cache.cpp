@@ -0,0 +1,131 @@
+/*************************************************************************
+    > File Name: feature_cache.cpp
+    > Author: Guo Hengkai
+    > Description: Persistent feature cache class implementation
+    > Created Time: Sat 11 Jul 2015 03:02:46 PM CST
+ ************************************************************************/
+#include "feature_cache.h"
+
+namespace ghk
+{
+namespace
+{
+const char FEATURE_CACHE_MAGIC[8] = {'G', 'H', 'K', 'F', 'E', 'A', 'T', '1'};
+const uint64_t FNV_PRIME = 1099511628211ULL;
+const size_t ROW_HEAD_SIZE = sizeof(uint64_t) + sizeof(int32_t);
+}  // namespace
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const uchar *bytes = static_cast<const uchar*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t HashImage(const Mat &image, uint64_t seed)
+{
+    int32_t head[3] = {image.rows, image.cols, image.type()};
+    uint64_t hash = HashBytes(head, sizeof(head), seed);
+    size_t row_size = image.cols * image.elemSize();
+    for (int i = 0; i < image.rows; ++i)
+    {
+        hash = HashBytes(image.ptr(i), row_size, hash);
+    }
+    return hash;
+}
+
+FeatureCache::~FeatureCache()
+{
+    Close();
+}
+
+bool FeatureCache::Open(const string &file_name)
+{
+    Close();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The rows saved by the earlier runs stay in the mapping
+    bool flag = file_.Open(file_name, FEATURE_CACHE_MAGIC,
+            sizeof(FEATURE_CACHE_MAGIC), [&](const char *data, size_t size) {
+        uint64_t key;
+        int32_t dim;
+        if (size < ROW_HEAD_SIZE)
+        {
+            return size_t(0);
+        }
+        memcpy(&key, data, sizeof(key));
+        memcpy(&dim, data + sizeof(key), sizeof(dim));
+        size_t row_size = ROW_HEAD_SIZE + dim * sizeof(float);
+        if (dim <= 0 || row_size > size)
+        {
+            return size_t(0);
+        }
+        rows_[key] = Row{reinterpret_cast<const float*>(
+                data + ROW_HEAD_SIZE), dim};
+        return row_size;
+    });
+    printf("Feature cache: %zu rows from %s\n", rows_.size(),
+            file_name.c_str());
+    return flag;
+}
+
+void FeatureCache::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    rows_.clear();
+    new_rows_.clear();
+    file_.Close();
+}
+
+bool FeatureCache::Get(uint64_t key, int dim, float *feat)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = rows_.find(key);
+    if (iter == rows_.end() || iter->second.dim != dim)
+    {
+        return false;
+    }
+    memcpy(feat, iter->second.data, dim * sizeof(float));
+    ++hit_;
+    return true;
+}
+
+int FeatureCache::GetDim(uint64_t key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = rows_.find(key);
+    return iter == rows_.end() ? 0 : iter->second.dim;
+}
+
+void FeatureCache::Put(uint64_t key, const float *feat, int dim)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++miss_;
+    if (rows_.find(key) != rows_.end())
+    {
+        return;
+    }
+    vector<float> &row = new_rows_[key];
+    row.assign(feat, feat + dim);
+    rows_[key] = Row{row.data(), dim};
+
+    int32_t dim32 = dim;
+    file_.Write(&key, sizeof(key));
+    file_.Write(&dim32, sizeof(dim32));
+    file_.Write(feat, dim * sizeof(float));
+    file_.Flush();
+}
+
+void FeatureCache::PrintStat() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = hit_ + miss_;
+    printf("Feature cache: %zu hits, %zu misses (%0.2f%% hit), "
+            "%zu rows\n", hit_, miss_, 100.0f * hit_ / max(total, size_t(1)),
+            rows_.size());
+}
+}  // namespace ghk
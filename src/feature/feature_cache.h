@@ -0,0 +1,62 @@
+/*************************************************************************
+    > File Name: feature_cache.h
+    > Author: Guo Hengkai
+    > Description: Persistent feature cache class definition
+    > Created Time: Sat 11 Jul 2015 02:35:18 PM CST
+ ************************************************************************/
+#ifndef FINAL_FEATURE_CACHE_H_
+#define FINAL_FEATURE_CACHE_H_
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include "common.h"
+#include "record_file.h"
+
+namespace ghk
+{
+const string FEATURE_CACHE_NAME = "/feature.cache";  // cache in base_dir
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+// FNV-1a hash of the bytes, chained through seed
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed = FNV_OFFSET);
+// Hash of the size, type and pixels of the image
+uint64_t HashImage(const Mat &image, uint64_t seed = FNV_OFFSET);
+
+// Feature rows keyed by the image and the extractor parameters. Rows
+// from earlier runs are memory-mapped from the file and new rows are
+// appended to it, so they are shared by all the later runs.
+class FeatureCache
+{
+public:
+    FeatureCache(): hit_(0), miss_(0) {}
+    ~FeatureCache();
+
+    bool Open(const string &file_name);
+    void Close();
+
+    // Copy the cached row into feat of dim floats if it exists
+    bool Get(uint64_t key, int dim, float *feat);
+    // Dimension of the cached row, 0 if it does not exist
+    int GetDim(uint64_t key) const;
+    void Put(uint64_t key, const float *feat, int dim);
+
+    void PrintStat() const;
+
+private:
+    struct Row
+    {
+        const float *data;
+        int dim;
+    };
+
+    mutable std::mutex mutex_;
+    RecordFile file_;
+    std::unordered_map<uint64_t, Row> rows_;
+    std::unordered_map<uint64_t, vector<float>> new_rows_;
+    size_t hit_;
+    size_t miss_;
+};
+}  // namespace ghk
+
+#endif  // FINAL_FEATURE_CACHE_H_
@@ -10,7 +10,7 @@
 
 namespace ghk
 {
-FisherExtractor::FisherExtractor()
+FisherExtractor::FisherExtractor(): proj_key_(0)
 {
 }
 
@@ -37,6 +37,7 @@ bool FisherExtractor::Load(const string &model_name)
     {
         return false;
     }
+    UpdateProjKey();
     return true;
 }
 
@@ -70,6 +71,7 @@ bool FisherExtractor::Train(const vector<Mat> &images,
     lda_vectors.convertTo(lda_vectors, CV_32F);
     cv::gemm(pca.eigenvectors, lda_vectors, 1.0, Mat(), 0.0,
             eigen_vector_, cv::GEMM_1_T);
+    UpdateProjKey();
     printf("Done!\n");
     return true;
 }
@@ -91,4 +93,20 @@ bool FisherExtractor::Extract(const vector<Mat> &images, Mat *feats)
     *feats = cv::subspaceProject(eigen_vector_, mean_, image_vecs);
     return true;
 }
+
+uint64_t FisherExtractor::GetParamKey() const
+{
+    if (proj_key_ == 0)
+    {
+        return 0;
+    }
+    int32_t dim = feat_dim();
+    return HashBytes(&dim, sizeof(dim), proj_key_);
+}
+
+void FisherExtractor::UpdateProjKey()
+{
+    proj_key_ = HashImage(mean_, HashImage(eigen_vector_,
+                HashBytes("fisher", 6)));
+}
 }  // namespace ghk
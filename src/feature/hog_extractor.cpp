@@ -9,23 +9,17 @@ extern "C"
 {
 #include "hog.h"
 }
+#include <atomic>
 #include "mat_util.h"
+#include "thread_pool.h"
 #include "file_util.h"
 
 namespace ghk
 {
 HogExtractor::HogExtractor(int num_orient, int cell_size):
-    hog_(nullptr), num_orient_(num_orient), cell_size_(cell_size)
+    num_orient_(num_orient), cell_size_(cell_size), use_native_(true)
 {
-    Update();
-}
-
-HogExtractor::~HogExtractor()
-{
-    if (hog_ != nullptr)
-    {
-        vl_hog_delete(hog_);
-    }
+    set_feat_dim(0);
 }
 
 bool HogExtractor::Save(const string &model_name) const
@@ -54,57 +48,177 @@ bool HogExtractor::Load(const string &model_name)
     num_orient_ = param[0];
     cell_size_ = param[1];
 
-    Update();
-
     return true;
 }
 
 bool HogExtractor::Extract(const vector<Mat> &images, Mat *feats)
+{
+    if (!ExtractBatch(images, feats))
+    {
+        return false;
+    }
+    if (!images.empty())
+    {
+        set_feat_dim(feats->cols);
+    }
+    return true;
+}
+
+uint64_t HogExtractor::GetParamKey() const
+{
+    int32_t param[2] = {num_orient_, cell_size_};
+    return HashBytes(param, sizeof(param), HashBytes("hog", 3));
+}
+
+bool HogExtractor::ExtractBatch(const vector<Mat> &images, Mat *feats) const
 {
     if (feats == nullptr)
     {
         return false;
     }
+    if (images.empty())
+    {
+        *feats = Mat();
+        return true;
+    }
+
+    // Suppose sizes of image are same, so the output is sized only once
+    // and each row is written in place
+    int width = GetCellNum(images[0].cols);
+    int height = GetCellNum(images[0].rows);
+    int dim = width * height * dimension();
+    feats->create(static_cast<int>(images.size()), dim, CV_32F);
+
+    // One HOG handle and conversion buffer for each thread, the native
+    // kernel is used for 8-bit images when available
+    const HogKernel *kernel = GetKernel();
+    ThreadPool &pool = ThreadPool::Default();
+    vector<VlHog*> hogs(pool.thread_num(), nullptr);
+    vector<Mat> buffers(pool.thread_num());
+    std::atomic<bool> is_valid(true);
+    pool.ParallelFor(images.size(), [&](size_t i, int thread_id) {
+        if (images[i].cols != images[0].cols
+                || images[i].rows != images[0].rows)
+        {
+            is_valid = false;
+            return;
+        }
+        if (kernel != nullptr && images[i].depth() == CV_8U)
+        {
+            Mat &gray = buffers[thread_id];
+            ConvertGray(images[i], &gray);
+            kernel->Extract(gray, feats->ptr<float>(static_cast<int>(i)));
+            return;
+        }
 
-    *feats = Mat();
-    for (auto image: images)
+        VlHog *&hog = hogs[thread_id];
+        if (hog == nullptr)
+        {
+            hog = vl_hog_new(VlHogVariantDalalTriggs, num_orient_, VL_FALSE);
+        }
+        Mat &image_float = buffers[thread_id];
+        ConvertFloatGray(images[i], &image_float);
+        vl_hog_put_image(hog, image_float.ptr<float>(), images[i].cols,
+                images[i].rows, 1, cell_size_);
+        vl_hog_extract(hog, feats->ptr<float>(static_cast<int>(i)));
+    });
+    for (auto hog: hogs)
     {
-        // Convert Mat to float array
-        float image_data[image.total()];
-        int k = 0;
-        for (int i = 0; i < image.rows; ++i)
-            for (int j = 0; j < image.cols; ++j, ++k)
-            {
-                image_data[k] = image.at<int>(i, j);
-            }
-
-        // Extract HOG features
-        vl_hog_put_image(hog_, image_data, image.rows, image.cols,
-                image.channels(), cell_size_);
-        set_feat_dim(vl_hog_get_width(hog_) * vl_hog_get_height(hog_)
-                * vl_hog_get_dimension(hog_));
-        float *hog_arr = (float*)vl_malloc(feat_dim() * sizeof(float));
-        vl_hog_extract(hog_, hog_arr);
-
-        // Convert float array to Mat
-        Mat feat_row(1, feat_dim(), CV_32F);
-        for (int i = 0; i < feat_dim(); ++i)
+        if (hog != nullptr)
         {
-            feat_row.at<float>(0, i) = hog_arr[i];
+            vl_hog_delete(hog);
         }
-        vl_free(hog_arr);
+    }
 
-        feats->push_back(feat_row);
+    if (!is_valid)
+    {
+        printf("Images of different sizes for HOG extraction.\n");
+        return false;
     }
     return true;
 }
 
-void HogExtractor::Update()
+bool HogExtractor::ExtractGrid(const Mat &image, Mat *grid) const
 {
-    if (hog_ != nullptr)
+    if (grid == nullptr || image.empty())
     {
-        vl_hog_delete(hog_);
+        return false;
     }
-    hog_ = vl_hog_new(VlHogVariantDalalTriggs, num_orient_, VL_FALSE);
+
+    const HogKernel *kernel = GetKernel();
+    if (kernel != nullptr && image.depth() == CV_8U)
+    {
+        Mat gray;
+        ConvertGray(image, &gray);
+        grid->create(dimension() * GetCellNum(image.rows),
+                GetCellNum(image.cols), CV_32F);
+        kernel->Extract(gray, grid->ptr<float>());
+        return true;
+    }
+
+    Mat image_float;
+    ConvertFloatGray(image, &image_float);
+
+    // Use a local handle so that the extractor itself is not modified
+    VlHog *hog = vl_hog_new(VlHogVariantDalalTriggs, num_orient_, VL_FALSE);
+    vl_hog_put_image(hog, image_float.ptr<float>(), image.cols, image.rows,
+            1, cell_size_);
+    int width = static_cast<int>(vl_hog_get_width(hog));
+    int height = static_cast<int>(vl_hog_get_height(hog));
+    int dim = static_cast<int>(vl_hog_get_dimension(hog));
+    grid->create(dim * height, width, CV_32F);
+    vl_hog_extract(hog, grid->ptr<float>());
+    vl_hog_delete(hog);
+    return true;
+}
+
+void HogExtractor::GetWindowFeat(const Mat &grid, int x, int y,
+        int win_cells, float *feat) const
+{
+    int dim = dimension();
+    int height = grid.rows / dim;
+    for (int k = 0; k < dim; ++k)
+        for (int i = 0; i < win_cells; ++i)
+        {
+            const float *src = grid.ptr<float>(k * height + y + i) + x;
+            memcpy(feat, src, win_cells * sizeof(float));
+            feat += win_cells;
+        }
+}
+
+const HogKernel* HogExtractor::GetKernel() const
+{
+    return use_native_ ? HogKernel::Get(num_orient_, cell_size_) : nullptr;
 }
+
+void HogExtractor::ConvertGray(const Mat &image, Mat *gray)
+{
+    if (image.channels() > 1)
+    {
+        cv::cvtColor(image, *gray, CV_BGR2GRAY);
+    }
+    else
+    {
+        *gray = image;
+    }
+}
+
+void HogExtractor::ConvertFloatGray(const Mat &image, Mat *image_float)
+{
+    if (image.channels() > 1)
+    {
+        Mat gray;
+        cv::cvtColor(image, gray, CV_BGR2GRAY);
+        gray.convertTo(*image_float, CV_32F);
+    }
+    else
+    {
+        image.convertTo(*image_float, CV_32F);
+    }
+    if (!image_float->isContinuous())
+    {
+        *image_float = image_float->clone();
+    }
+}
+
 }  // namespace ghk
@@ -9,6 +9,7 @@
 
 #include "common.h"
 #include "extractor.h"
+#include "hog_kernel.h"
 extern "C"
 {
 #include "hog.h"
@@ -20,30 +21,47 @@ class HogExtractor: public Extractor
 {
 public:
     HogExtractor(int num_orient = 8, int cell_size = 8);
-    ~HogExtractor();
 
     virtual bool Save(const string &model_name) const;
     virtual bool Load(const string &model_name);
     virtual bool Train(const vector<Mat> &images,
                 const vector<int> &labels) { return false; }
     virtual bool Extract(const vector<Mat> &images, Mat *feats);
+    virtual uint64_t GetParamKey() const;
 
-    inline void set_num_orient(int num_orient)
+    // Thread-safe extraction of images with the same size, running in
+    // parallel with one HOG handle for each thread
+    bool ExtractBatch(const vector<Mat> &images, Mat *feats) const;
+
+    // Extract the HOG cell grid of a whole image. The planes of the
+    // feature dimensions are stacked vertically: (dimension * h) x w
+    bool ExtractGrid(const Mat &image, Mat *grid) const;
+    // Copy the feature of the window with top-left cell (x, y) and
+    // win_cells x win_cells cells in the same layout as Extract
+    void GetWindowFeat(const Mat &grid, int x, int y, int win_cells,
+            float *feat) const;
+    // Number of cells along one side of a square image
+    inline int GetCellNum(int image_size) const
     {
-        if (num_orient_ != num_orient)
-        {
-            num_orient_ = num_orient;
-            Update();
-        }
+        return (image_size + cell_size_ / 2) / cell_size_;
     }
+
+    inline void set_num_orient(int num_orient) { num_orient_ = num_orient; }
     inline void set_cell_size(int cell_size) { cell_size_ = cell_size; }
+    // Use the native kernel instead of vlfeat when it is compiled in
+    inline void set_use_native(bool use_native) { use_native_ = use_native; }
+    inline int num_orient() const { return num_orient_; }
+    inline int cell_size() const { return cell_size_; }
+    inline int dimension() const { return 4 * num_orient_; }  // Dalal-Triggs
 
 private:
-    VlHog *hog_;
     int num_orient_;
     int cell_size_;
+    bool use_native_;
 
-    void Update();
+    const HogKernel* GetKernel() const;
+    static void ConvertGray(const Mat &image, Mat *gray);
+    static void ConvertFloatGray(const Mat &image, Mat *image_float);
 };
 }  // namespace ghk
 
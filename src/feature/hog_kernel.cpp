@@ -0,0 +1,581 @@
+/*************************************************************************
+    > File Name: hog_kernel.cpp
+    > Author: Guo Hengkai
+    > Description: Native HOG kernel class implementation
+    > Created Time: Fri 10 Jul 2015 09:48:12 AM CST
+ ************************************************************************/
+#include "hog_kernel.h"
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+extern "C"
+{
+#include "hog.h"
+}
+
+namespace ghk
+{
+namespace
+{
+const float HOG_CLAMP = 0.2f;  // Dalal-Triggs clamping of normalized bins
+const float HOG_CHECK_TOLERANCE = 1e-4f;
+
+enum SimdLevel
+{
+    SIMD_NONE = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+SimdLevel GetSimdLevel()
+{
+#ifdef __SSE2__
+    static const SimdLevel level = __builtin_cpu_supports("avx2")
+        ? SIMD_AVX2 : SIMD_SSE2;
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+// Gradient magnitude and signed orientation bin of pixels [begin, end)
+// in a row, with the same arithmetic as vlfeat
+template <int ORIENT>
+void OrientRowScalar(const uchar *up, const uchar *mid, const uchar *down,
+        int begin, int end, const float *orient_x, const float *orient_y,
+        float *mag, int *bin)
+{
+    for (int x = begin; x < end; ++x)
+    {
+        float gx = static_cast<float>(mid[x + 1]) - mid[x - 1];
+        float gy = static_cast<float>(down[x]) - up[x];
+        float best = 0;
+        int best_bin = 0;
+        for (int k = 0; k < ORIENT; ++k)
+        {
+            float score = gx * orient_x[k] + gy * orient_y[k];
+            if (std::fabs(score) > best)
+            {
+                best = std::fabs(score);
+                best_bin = score < 0 ? k + ORIENT : k;
+            }
+        }
+        mag[x] = std::sqrt(gx * gx + gy * gy);
+        bin[x] = best_bin;
+    }
+}
+
+// Squared norm of the unsigned histogram of each cell
+template <int ORIENT>
+void CellNormScalar(const float *hist, int stride, float *norm)
+{
+    for (int k = 0; k < ORIENT; ++k)
+    {
+        const float *h1 = hist + k * stride;
+        const float *h2 = hist + (k + ORIENT) * stride;
+        for (int i = 0; i < stride; ++i)
+        {
+            float h = h1[i] + h2[i];
+            norm[i] += h * h;
+        }
+    }
+}
+
+// One normalized and clamped feature plane
+void ClampRowScalar(const float *h1, const float *h2, const double *factor,
+        int n, float *out)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        double h = h1[i] + h2[i];
+        out[i] = static_cast<float>(std::min(h * factor[i],
+                    static_cast<double>(HOG_CLAMP)));
+    }
+}
+
+#ifdef __SSE2__
+inline __m128 LoadSse(const uchar *p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    __m128i zero = _mm_setzero_si128();
+    __m128i w = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero));
+}
+
+inline __m128 BlendSse(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+template <int ORIENT>
+int OrientRowSse(const uchar *up, const uchar *mid, const uchar *down,
+        int begin, int end, const float *orient_x, const float *orient_y,
+        float *mag, int *bin)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 orient = _mm_set1_ps(static_cast<float>(ORIENT));
+    int x = begin;
+    for (; x + 4 <= end; x += 4)
+    {
+        __m128 gx = _mm_sub_ps(LoadSse(mid + x + 1), LoadSse(mid + x - 1));
+        __m128 gy = _mm_sub_ps(LoadSse(down + x), LoadSse(up + x));
+        __m128 best = zero;
+        __m128 best_bin = zero;
+        for (int k = 0; k < ORIENT; ++k)
+        {
+            __m128 score = _mm_add_ps(_mm_mul_ps(gx, _mm_set1_ps(orient_x[k])),
+                    _mm_mul_ps(gy, _mm_set1_ps(orient_y[k])));
+            __m128 abs_score = _mm_andnot_ps(sign, score);
+            __m128 k_bin = _mm_add_ps(_mm_set1_ps(static_cast<float>(k)),
+                    _mm_and_ps(_mm_cmplt_ps(score, zero), orient));
+            __m128 is_better = _mm_cmpgt_ps(abs_score, best);
+            best = BlendSse(is_better, best, abs_score);
+            best_bin = BlendSse(is_better, best_bin, k_bin);
+        }
+        _mm_storeu_ps(mag + x, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(gx, gx),
+                        _mm_mul_ps(gy, gy))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bin + x),
+                _mm_cvttps_epi32(best_bin));
+    }
+    return x;
+}
+
+template <int ORIENT>
+void CellNormSse(const float *hist, int stride, float *norm)
+{
+    for (int k = 0; k < ORIENT; ++k)
+    {
+        const float *h1 = hist + k * stride;
+        const float *h2 = hist + (k + ORIENT) * stride;
+        int i = 0;
+        for (; i + 4 <= stride; i += 4)
+        {
+            __m128 h = _mm_add_ps(_mm_loadu_ps(h1 + i), _mm_loadu_ps(h2 + i));
+            _mm_storeu_ps(norm + i, _mm_add_ps(_mm_loadu_ps(norm + i),
+                        _mm_mul_ps(h, h)));
+        }
+        for (; i < stride; ++i)
+        {
+            float h = h1[i] + h2[i];
+            norm[i] += h * h;
+        }
+    }
+}
+
+void ClampRowSse(const float *h1, const float *h2, const double *factor,
+        int n, float *out)
+{
+    const __m128d clamp = _mm_set1_pd(HOG_CLAMP);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 h = _mm_add_ps(_mm_loadu_ps(h1 + i), _mm_loadu_ps(h2 + i));
+        __m128d lo = _mm_min_pd(_mm_mul_pd(_mm_cvtps_pd(h),
+                    _mm_loadu_pd(factor + i)), clamp);
+        __m128d hi = _mm_min_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(h, h)),
+                    _mm_loadu_pd(factor + i + 2)), clamp);
+        _mm_storeu_ps(out + i, _mm_movelh_ps(_mm_cvtpd_ps(lo),
+                    _mm_cvtpd_ps(hi)));
+    }
+    ClampRowScalar(h1 + i, h2 + i, factor + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+inline __m256 LoadAvx(const uchar *p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+template <int ORIENT>
+__attribute__((target("avx2")))
+int OrientRowAvx(const uchar *up, const uchar *mid, const uchar *down,
+        int begin, int end, const float *orient_x, const float *orient_y,
+        float *mag, int *bin)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 orient = _mm256_set1_ps(static_cast<float>(ORIENT));
+    int x = begin;
+    for (; x + 8 <= end; x += 8)
+    {
+        __m256 gx = _mm256_sub_ps(LoadAvx(mid + x + 1), LoadAvx(mid + x - 1));
+        __m256 gy = _mm256_sub_ps(LoadAvx(down + x), LoadAvx(up + x));
+        __m256 best = zero;
+        __m256 best_bin = zero;
+        for (int k = 0; k < ORIENT; ++k)
+        {
+            // No FMA here to round the same as vlfeat
+            __m256 score = _mm256_add_ps(
+                    _mm256_mul_ps(gx, _mm256_set1_ps(orient_x[k])),
+                    _mm256_mul_ps(gy, _mm256_set1_ps(orient_y[k])));
+            __m256 abs_score = _mm256_andnot_ps(sign, score);
+            __m256 k_bin = _mm256_add_ps(
+                    _mm256_set1_ps(static_cast<float>(k)),
+                    _mm256_and_ps(_mm256_cmp_ps(score, zero, _CMP_LT_OQ),
+                        orient));
+            __m256 is_better = _mm256_cmp_ps(abs_score, best, _CMP_GT_OQ);
+            best = _mm256_blendv_ps(best, abs_score, is_better);
+            best_bin = _mm256_blendv_ps(best_bin, k_bin, is_better);
+        }
+        _mm256_storeu_ps(mag + x, _mm256_sqrt_ps(_mm256_add_ps(
+                        _mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy))));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bin + x),
+                _mm256_cvttps_epi32(best_bin));
+    }
+    return x;
+}
+
+template <int ORIENT>
+__attribute__((target("avx2")))
+void CellNormAvx(const float *hist, int stride, float *norm)
+{
+    for (int k = 0; k < ORIENT; ++k)
+    {
+        const float *h1 = hist + k * stride;
+        const float *h2 = hist + (k + ORIENT) * stride;
+        int i = 0;
+        for (; i + 8 <= stride; i += 8)
+        {
+            __m256 h = _mm256_add_ps(_mm256_loadu_ps(h1 + i),
+                    _mm256_loadu_ps(h2 + i));
+            _mm256_storeu_ps(norm + i, _mm256_add_ps(
+                        _mm256_loadu_ps(norm + i), _mm256_mul_ps(h, h)));
+        }
+        for (; i < stride; ++i)
+        {
+            float h = h1[i] + h2[i];
+            norm[i] += h * h;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void ClampRowAvx(const float *h1, const float *h2, const double *factor,
+        int n, float *out)
+{
+    const __m256d clamp = _mm256_set1_pd(HOG_CLAMP);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 h = _mm_add_ps(_mm_loadu_ps(h1 + i), _mm_loadu_ps(h2 + i));
+        __m256d v = _mm256_min_pd(_mm256_mul_pd(_mm256_cvtps_pd(h),
+                    _mm256_loadu_pd(factor + i)), clamp);
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(v));
+    }
+    ClampRowScalar(h1 + i, h2 + i, factor + i, n - i, out + i);
+}
+#endif  // __SSE2__
+
+template <int ORIENT, int CELL>
+class HogKernelImpl: public HogKernel
+{
+public:
+    HogKernelImpl(const float *orient_x, const float *orient_y)
+    {
+        memcpy(orient_x_, orient_x, sizeof(orient_x_));
+        memcpy(orient_y_, orient_y, sizeof(orient_y_));
+    }
+
+    virtual void Extract(const Mat &image, float *feat) const;
+
+private:
+    float orient_x_[ORIENT];
+    float orient_y_[ORIENT];
+
+    void OrientRow(const uchar *up, const uchar *mid, const uchar *down,
+            int begin, int end, float *mag, int *bin) const;
+    void CellNorm(const float *hist, int stride, float *norm) const;
+    void ClampRow(const float *h1, const float *h2, const double *factor,
+            int n, float *out) const;
+};
+
+template <int ORIENT, int CELL>
+void HogKernelImpl<ORIENT, CELL>::Extract(const Mat &image,
+        float *feat) const
+{
+    int width = image.cols;
+    int height = image.rows;
+    int hog_width = (width + CELL / 2) / CELL;
+    int hog_height = (height + CELL / 2) / CELL;
+    int stride = hog_width * hog_height;
+
+    // Buffers are kept for each thread between the calls
+    thread_local vector<float> hist;
+    thread_local vector<float> norm;
+    thread_local vector<double> factor;
+    thread_local vector<float> mag;
+    thread_local vector<int> bin;
+    thread_local vector<int> cell_x;
+    thread_local vector<float> weight_x;
+    hist.assign(stride * ORIENT * 2, 0);
+    norm.assign(stride, 0);
+    factor.resize(stride * 4);
+    mag.resize(width);
+    bin.resize(width);
+    cell_x.resize(width);
+    weight_x.resize(width);
+
+    // Pixel x is shared by the cells on its left and right with bilinear
+    // weights, hx is 0 at the center of a cell and 1 at the next one
+    for (int x = 0; x < width; ++x)
+    {
+        float hx = static_cast<float>((x + 0.5) / CELL - 0.5);
+        cell_x[x] = static_cast<int>(std::floor(hx));
+        weight_x[x] = hx - cell_x[x];
+    }
+
+    // Histograms of the signed orientations, borders are skipped
+    for (int y = 1; y < height - 1; ++y)
+    {
+        OrientRow(image.ptr<uchar>(y - 1), image.ptr<uchar>(y),
+                image.ptr<uchar>(y + 1), 1, width - 1, mag.data(), bin.data());
+
+        float hy = static_cast<float>((y + 0.5) / CELL - 0.5);
+        int by = static_cast<int>(std::floor(hy));
+        float wy2 = hy - by;
+        float wy1 = 1.0f - wy2;
+        bool has_top = by >= 0;
+        bool has_bottom = by < hog_height - 1;
+        for (int x = 1; x < width - 1; ++x)
+        {
+            float m = mag[x];
+            int bx = cell_x[x];
+            float wx2 = weight_x[x];
+            float wx1 = 1.0f - wx2;
+            float *h = hist.data() + bin[x] * stride;
+            int idx = by * hog_width + bx;
+            if (bx >= 0 && has_top)
+            {
+                h[idx] += m * wx1 * wy1;
+            }
+            if (bx < hog_width - 1 && has_top)
+            {
+                h[idx + 1] += m * wx2 * wy1;
+            }
+            if (bx < hog_width - 1 && has_bottom)
+            {
+                h[idx + hog_width + 1] += m * wx2 * wy2;
+            }
+            if (bx >= 0 && has_bottom)
+            {
+                h[idx + hog_width] += m * wx1 * wy2;
+            }
+        }
+    }
+
+    // Normalization factors of the four blocks around each cell
+    CellNorm(hist.data(), stride, norm.data());
+    for (int y = 0; y < hog_height; ++y)
+    {
+        int ym = std::max(y - 1, 0) * hog_width;
+        int yc = y * hog_width;
+        int yp = std::min(y + 1, hog_height - 1) * hog_width;
+        for (int x = 0; x < hog_width; ++x)
+        {
+            int xm = std::max(x - 1, 0);
+            int xp = std::min(x + 1, hog_width - 1);
+            double n1 = norm[xm + ym];
+            double n2 = norm[x + ym];
+            double n3 = norm[xp + ym];
+            double n4 = norm[xm + yc];
+            double n5 = norm[x + yc];
+            double n6 = norm[xp + yc];
+            double n7 = norm[xm + yp];
+            double n8 = norm[x + yp];
+            double n9 = norm[xp + yp];
+            int i = x + yc;
+            factor[i] = 1.0 / std::sqrt(n1 + n2 + n4 + n5 + 1e-4);
+            factor[i + stride] = 1.0 / std::sqrt(n2 + n3 + n5 + n6 + 1e-4);
+            factor[i + 2 * stride] = 1.0 / std::sqrt(n4 + n5 + n7 + n8 + 1e-4);
+            factor[i + 3 * stride] = 1.0 / std::sqrt(n5 + n6 + n8 + n9 + 1e-4);
+        }
+    }
+
+    // Unsigned histogram under each block normalization
+    for (int j = 0; j < 4; ++j)
+        for (int k = 0; k < ORIENT; ++k)
+        {
+            ClampRow(hist.data() + k * stride,
+                    hist.data() + (k + ORIENT) * stride,
+                    factor.data() + j * stride, stride,
+                    feat + (j * ORIENT + k) * stride);
+        }
+}
+
+template <int ORIENT, int CELL>
+void HogKernelImpl<ORIENT, CELL>::OrientRow(const uchar *up,
+        const uchar *mid, const uchar *down, int begin, int end,
+        float *mag, int *bin) const
+{
+#ifdef __SSE2__
+    switch (GetSimdLevel())
+    {
+        case SIMD_AVX2:
+            begin = OrientRowAvx<ORIENT>(up, mid, down, begin, end,
+                    orient_x_, orient_y_, mag, bin);
+            break;
+        case SIMD_SSE2:
+            begin = OrientRowSse<ORIENT>(up, mid, down, begin, end,
+                    orient_x_, orient_y_, mag, bin);
+            break;
+        default:
+            break;
+    }
+#endif
+    OrientRowScalar<ORIENT>(up, mid, down, begin, end, orient_x_, orient_y_,
+            mag, bin);
+}
+
+template <int ORIENT, int CELL>
+void HogKernelImpl<ORIENT, CELL>::CellNorm(const float *hist, int stride,
+        float *norm) const
+{
+#ifdef __SSE2__
+    switch (GetSimdLevel())
+    {
+        case SIMD_AVX2:
+            CellNormAvx<ORIENT>(hist, stride, norm);
+            return;
+        case SIMD_SSE2:
+            CellNormSse<ORIENT>(hist, stride, norm);
+            return;
+        default:
+            break;
+    }
+#endif
+    CellNormScalar<ORIENT>(hist, stride, norm);
+}
+
+template <int ORIENT, int CELL>
+void HogKernelImpl<ORIENT, CELL>::ClampRow(const float *h1, const float *h2,
+        const double *factor, int n, float *out) const
+{
+#ifdef __SSE2__
+    switch (GetSimdLevel())
+    {
+        case SIMD_AVX2:
+            ClampRowAvx(h1, h2, factor, n, out);
+            return;
+        case SIMD_SSE2:
+            ClampRowSse(h1, h2, factor, n, out);
+            return;
+        default:
+            break;
+    }
+#endif
+    ClampRowScalar(h1, h2, factor, n, out);
+}
+
+template <int ORIENT>
+HogKernel* CreateKernel(int cell_size, const float *orient_x,
+        const float *orient_y)
+{
+    switch (cell_size)
+    {
+        case 4:
+            return new HogKernelImpl<ORIENT, 4>(orient_x, orient_y);
+        case 6:
+            return new HogKernelImpl<ORIENT, 6>(orient_x, orient_y);
+        case 8:
+            return new HogKernelImpl<ORIENT, 8>(orient_x, orient_y);
+        default:
+            return nullptr;
+    }
+}
+
+// Only the configurations in use are compiled in
+HogKernel* CreateKernel(int num_orient, int cell_size,
+        const float *orient_x, const float *orient_y)
+{
+    switch (num_orient)
+    {
+        case 4:
+            return CreateKernel<4>(cell_size, orient_x, orient_y);
+        case 6:
+            return CreateKernel<6>(cell_size, orient_x, orient_y);
+        case 8:
+            return CreateKernel<8>(cell_size, orient_x, orient_y);
+        case 9:
+            return CreateKernel<9>(cell_size, orient_x, orient_y);
+        default:
+            return nullptr;
+    }
+}
+
+// Largest difference to vlfeat on random images
+float CompareKernel(const HogKernel &kernel, VlHog *hog, int cell_size)
+{
+    const vector<Size> sizes{Size(50, 50), Size(37, 45), Size(100, 100)};
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> dist(0, 255);
+    float max_diff = 0;
+    for (auto &size: sizes)
+    {
+        Mat image(size, CV_8U);
+        Mat image_float(size, CV_32F);
+        for (int y = 0; y < size.height; ++y)
+            for (int x = 0; x < size.width; ++x)
+            {
+                image.at<uchar>(y, x) = static_cast<uchar>(dist(rng));
+                image_float.at<float>(y, x) = image.at<uchar>(y, x);
+            }
+
+        vl_hog_put_image(hog, image_float.ptr<float>(), size.width,
+                size.height, 1, cell_size);
+        size_t dim = vl_hog_get_width(hog) * vl_hog_get_height(hog)
+            * vl_hog_get_dimension(hog);
+        vector<float> expect(dim);
+        vector<float> feat(dim);
+        vl_hog_extract(hog, expect.data());
+        kernel.Extract(image, feat.data());
+        for (size_t i = 0; i < dim; ++i)
+        {
+            max_diff = std::max(max_diff, std::fabs(expect[i] - feat[i]));
+        }
+    }
+    return max_diff;
+}
+}  // namespace
+
+const HogKernel* HogKernel::Get(int num_orient, int cell_size)
+{
+    static std::mutex mutex;
+    static map<std::pair<int, int>, std::unique_ptr<HogKernel>> kernels;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = std::make_pair(num_orient, cell_size);
+    auto iter = kernels.find(key);
+    if (iter != kernels.end())
+    {
+        return iter->second.get();
+    }
+
+    // The orientation directions are taken from vlfeat itself
+    VlHog *hog = vl_hog_new(VlHogVariantDalalTriggs, num_orient, VL_FALSE);
+    std::unique_ptr<HogKernel> kernel(CreateKernel(num_orient, cell_size,
+                hog->orientationX, hog->orientationY));
+    if (kernel)
+    {
+        float diff = CompareKernel(*kernel, hog, cell_size);
+        if (diff > HOG_CHECK_TOLERANCE)
+        {
+            printf("Native HOG (%d, %d) differs from vlfeat by %g, "
+                    "using vlfeat instead.\n", num_orient, cell_size, diff);
+            kernel.reset();
+        }
+    }
+    vl_hog_delete(hog);
+
+    const HogKernel *result = kernel.get();
+    kernels[key] = std::move(kernel);
+    return result;
+}
+}  // namespace ghk
@@ -0,0 +1,32 @@
+/*************************************************************************
+    > File Name: hog_kernel.h
+    > Author: Guo Hengkai
+    > Description: Native HOG kernel class definition
+    > Created Time: Fri 10 Jul 2015 09:20:37 AM CST
+ ************************************************************************/
+#ifndef FINAL_HOG_KERNEL_H_
+#define FINAL_HOG_KERNEL_H_
+
+#include "common.h"
+
+namespace ghk
+{
+// Dalal-Triggs HOG on 8-bit gray images, specialized at compile time for
+// the cell size and the number of orientations, with SSE2/AVX2 kernels
+// chosen at run time. The features are laid out the same as vlfeat.
+class HogKernel
+{
+public:
+    virtual ~HogKernel() {}
+
+    // Write the (dimension * h) x w cell grid as vl_hog_extract does,
+    // the image must be CV_8UC1
+    virtual void Extract(const Mat &image, float *feat) const = 0;
+
+    // Kernel for the parameters, or nullptr if it is not compiled in or
+    // does not agree with vlfeat on this machine
+    static const HogKernel* Get(int num_orient, int cell_size);
+};
+}  // namespace ghk
+
+#endif  // FINAL_HOG_KERNEL_H_
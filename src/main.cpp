@@ -14,6 +14,7 @@
 #include "knn_sign_classifier.h"
 #include "hog_sign_classifier.h"
 #include "hog_sign_detector.h"
+#include "video_sign_detector.h"
 #include "timer.h"
 
 using namespace ghk;
@@ -28,6 +29,12 @@ void TestDataset()
     TestDataset(dataset);
 }
 
+void PackDataset()
+{
+    Dataset dataset(root_dir);
+    dataset.Pack(root_dir + PACK_NAME);
+}
+
 void TestClassifier()
 {
     // KnnClassifier classifier(10);
@@ -39,23 +46,38 @@ void TestClassifier()
 void TrainSignClassifier(SignClassifier *classifier, const string &model_name)
 {
     Dataset dataset(root_dir);
+    FeatureCache cache;
+    cache.Open(root_dir + FEATURE_CACHE_NAME);
+    classifier->SetFeatureCache(&cache);
     classifier->Train(dataset);
     classifier->Save(root_dir + model_dir + '/' + model_name);
     classifier->Load(root_dir + model_dir + '/' + model_name);
     classifier->Test(dataset);
+    cache.PrintStat();
+    classifier->SetFeatureCache(nullptr);
 }
 
 void FullTest(SignClassifier *classifier)
 {
     Dataset dataset(root_dir);
+    FeatureCache cache;
+    cache.Open(root_dir + FEATURE_CACHE_NAME);
+    classifier->SetFeatureCache(&cache);
     classifier->FullTest(dataset, root_dir + result_dir);
+    cache.PrintStat();
+    classifier->SetFeatureCache(nullptr);
 }
 
 void TrainDetector(const string &model_name)
 {
     Dataset dataset(root_dir);
     HogSignDetector detector(4, 4, 100, 50, true);
+    HardNegativePool pool;
+    pool.Open(root_dir + HARD_NEG_POOL_NAME);
+    detector.set_hard_neg_pool(&pool);
     detector.Train(dataset);
+    pool.PrintStat();
+    detector.set_hard_neg_pool(nullptr);
     detector.Save(root_dir + model_dir + '/' + model_name);
     
     detector.Load(root_dir + model_dir + '/' + model_name);
@@ -79,15 +101,28 @@ void TrainDetector(const string &model_name)
     float t1 = timer.Snapshot();
     printf("Time: %0.3fs\n", t1);
 
-    dataset.DrawRectAndLabel(res_rects[0], res_labels[0], &image[0]);
-    cv::imshow("", image[0]);
+    Mat canvas = image[0].clone();
+    dataset.DrawRectAndLabel(res_rects[0], res_labels[0], &canvas);
+    cv::imshow("", canvas);
     cv::waitKey();
 
     detector.Test(dataset);
 }
 
+void DetectVideo(const string &model_name, const string &video_name)
+{
+    HogSignDetector detector(4, 4, 100, 50, true);
+    if (!detector.Load(root_dir + model_dir + '/' + model_name))
+    {
+        return;
+    }
+    VideoSignDetector video_detector(&detector);
+    video_detector.Run(video_name, true);
+}
+
 int main(int argc, char **argv)
 {
+    // PackDataset();
     // TestDataset();
     // TestClassifier();
     // KnnSignClassifier classifier(true, 5, 180, 20, false);
@@ -98,5 +133,6 @@ int main(int argc, char **argv)
 
     // TrainDetector("hog_detector_without_mining_rf_deep");
     TrainDetector("hog_detector_mining_svm");
+    // DetectVideo("hog_detector_mining_svm", root_dir + "/data/video.avi");
     return 0;
 }
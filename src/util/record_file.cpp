@@ -0,0 +1,119 @@
+/*************************************************************************
+    > File Name: record_file.cpp
+    > Author: Guo Hengkai
+    > Description: Append-only mapped record file class implementation
+    > Created Time: Wed 15 Jul 2015 10:40:12 AM CST
+ ************************************************************************/
+#include "record_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ghk
+{
+RecordFile::~RecordFile()
+{
+    Close();
+}
+
+bool RecordFile::Open(const string &file_name, const char *magic,
+        size_t magic_size, const Parser &parse)
+{
+    Close();
+
+    // Map the records saved by the earlier runs
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0
+                && file_stat.st_size > static_cast<off_t>(magic_size))
+        {
+            void *data = mmap(nullptr, file_stat.st_size, PROT_READ,
+                    MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                map_data_ = data;
+                map_size_ = file_stat.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    size_t valid_size = 0;
+    const char *data = static_cast<const char*>(map_data_);
+    if (data != nullptr && memcmp(data, magic, magic_size) == 0)
+    {
+        size_t pos = magic_size;
+        while (pos < map_size_)
+        {
+            size_t size = parse(data + pos, map_size_ - pos);
+            if (size == 0 || size > map_size_ - pos)
+            {
+                break;
+            }
+            pos += size;
+        }
+        valid_size = pos;
+    }
+
+    // Append the new records, a record cut off by an interrupted run is
+    // dropped
+    if (valid_size > 0)
+    {
+        if (valid_size < map_size_ && truncate(file_name.c_str(),
+                    valid_size) != 0)
+        {
+            printf("Fail to truncate %s.\n", file_name.c_str());
+        }
+        out_file_ = fopen(file_name.c_str(), "ab");
+    }
+    else
+    {
+        out_file_ = fopen(file_name.c_str(), "wb");
+        if (out_file_ != nullptr)
+        {
+            fwrite(magic, 1, magic_size, out_file_);
+        }
+    }
+    if (out_file_ == nullptr)
+    {
+        printf("Fail to open %s, new records are not saved.\n",
+                file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+void RecordFile::Close()
+{
+    if (out_file_ != nullptr)
+    {
+        fclose(out_file_);
+        out_file_ = nullptr;
+    }
+    if (map_data_ != nullptr)
+    {
+        munmap(map_data_, map_size_);
+        map_data_ = nullptr;
+        map_size_ = 0;
+    }
+}
+
+void RecordFile::Write(const void *data, size_t size)
+{
+    if (out_file_ != nullptr)
+    {
+        fwrite(data, 1, size, out_file_);
+    }
+}
+
+void RecordFile::Flush()
+{
+    if (out_file_ != nullptr)
+    {
+        fflush(out_file_);
+    }
+}
+}  // namespace ghk
@@ -0,0 +1,46 @@
+/*************************************************************************
+    > File Name: record_file.h
+    > Author: Guo Hengkai
+    > Description: Append-only mapped record file class definition
+    > Created Time: Wed 15 Jul 2015 10:21:37 AM CST
+ ************************************************************************/
+#ifndef FINAL_RECORD_FILE_H_
+#define FINAL_RECORD_FILE_H_
+
+#include <functional>
+#include "common.h"
+
+namespace ghk
+{
+// Binary file of records after a magic. The records of the earlier runs
+// are memory-mapped read-only and stay valid until Close, a record cut
+// off by an interrupted run is truncated, and new records are appended.
+// It is not thread-safe.
+class RecordFile
+{
+public:
+    // Size of the record at the data with size bytes left, 0 if it is
+    // incomplete or broken
+    typedef std::function<size_t(const char *data, size_t size)> Parser;
+
+    RecordFile(): map_data_(nullptr), map_size_(0), out_file_(nullptr) {}
+    ~RecordFile();
+
+    // Call parse for each saved record and open the file for appending,
+    // false if new records can not be saved
+    bool Open(const string &file_name, const char *magic, size_t magic_size,
+            const Parser &parse);
+    void Close();
+
+    // A record is written in pieces and flushed when complete
+    void Write(const void *data, size_t size);
+    void Flush();
+
+private:
+    void *map_data_;
+    size_t map_size_;
+    FILE *out_file_;
+};
+}  // namespace ghk
+
+#endif  // FINAL_RECORD_FILE_H_
@@ -0,0 +1,106 @@
+/*************************************************************************
+    > File Name: rotate_augmenter.cpp
+    > Author: Guo Hengkai
+    > Description: Rotation augmentation class implementation with cached maps
+    > Created Time: Thu 09 Jul 2015 04:30:21 PM CST
+ ************************************************************************/
+#include "rotate_augmenter.h"
+#include "thread_pool.h"
+
+namespace ghk
+{
+RotateAugmenter& RotateAugmenter::Default()
+{
+    static RotateAugmenter augmenter;
+    return augmenter;
+}
+
+void RotateAugmenter::Rotate(const Mat &image, int angle, Mat *result)
+{
+    Mat map1, map2;
+    GetMaps(image.size(), angle, &map1, &map2);
+    cv::remap(image, *result, map1, map2, cv::INTER_LINEAR,
+            cv::BORDER_CONSTANT);
+}
+
+void RotateAugmenter::RotateBatch(vector<Mat> *images,
+        const vector<RotateJob> &jobs)
+{
+    if (jobs.empty())
+    {
+        return;
+    }
+
+    // One block for all the results if the sources are alike
+    const Mat &first = (*images)[jobs[0].src];
+    bool is_same = true;
+    for (auto &job: jobs)
+    {
+        const Mat &src = (*images)[job.src];
+        is_same = is_same && src.size() == first.size()
+            && src.type() == first.type();
+    }
+    if (is_same)
+    {
+        Mat block(static_cast<int>(jobs.size()) * first.rows, first.cols,
+                first.type());
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            (*images)[jobs[i].dst] = block.rowRange(
+                    static_cast<int>(i) * first.rows,
+                    static_cast<int>(i + 1) * first.rows);
+        }
+    }
+    else
+    {
+        for (auto &job: jobs)
+        {
+            const Mat &src = (*images)[job.src];
+            (*images)[job.dst].create(src.size(), src.type());
+        }
+    }
+
+    ThreadPool::Default().ParallelFor(jobs.size(),
+            [&](size_t i, int thread_id) {
+        Rotate((*images)[jobs[i].src], jobs[i].angle,
+                &(*images)[jobs[i].dst]);
+    });
+}
+
+void RotateAugmenter::GetMaps(Size size, int angle, Mat *map1, Mat *map2)
+{
+    MapKey key(size.height, size.width, angle);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = maps_.find(key);
+    if (iter != maps_.end())
+    {
+        *map1 = iter->second.first;
+        *map2 = iter->second.second;
+        return;
+    }
+
+    // Inverse mapping of warpAffine around the center as RotateImage
+    Mat mat = cv::getRotationMatrix2D(cv::Point2f((size.width - 1.0) / 2,
+                (size.height - 1.0) / 2), angle, 1.0);
+    Mat inv_mat;
+    cv::invertAffineTransform(mat, inv_mat);
+    Mat map_x(size, CV_32F);
+    Mat map_y(size, CV_32F);
+    for (int y = 0; y < size.height; ++y)
+    {
+        float *px = map_x.ptr<float>(y);
+        float *py = map_y.ptr<float>(y);
+        for (int x = 0; x < size.width; ++x)
+        {
+            px[x] = static_cast<float>(inv_mat.at<double>(0, 0) * x
+                    + inv_mat.at<double>(0, 1) * y + inv_mat.at<double>(0, 2));
+            py[x] = static_cast<float>(inv_mat.at<double>(1, 0) * x
+                    + inv_mat.at<double>(1, 1) * y + inv_mat.at<double>(1, 2));
+        }
+    }
+
+    // Fixed-point tables are faster to remap with
+    cv::convertMaps(map_x, map_y, *map1, *map2, CV_16SC2);
+    maps_[key] = std::make_pair(*map1, *map2);
+}
+}  // namespace ghk
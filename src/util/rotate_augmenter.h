@@ -0,0 +1,46 @@
+/*************************************************************************
+    > File Name: rotate_augmenter.h
+    > Author: Guo Hengkai
+    > Description: Rotation augmentation class definition with cached maps
+    > Created Time: Thu 09 Jul 2015 04:12:55 PM CST
+ ************************************************************************/
+#ifndef FINAL_ROTATE_AUGMENTER_H_
+#define FINAL_ROTATE_AUGMENTER_H_
+
+#include <mutex>
+#include <tuple>
+#include "common.h"
+
+namespace ghk
+{
+// Rotation of images[src] by angle degrees written into images[dst]
+struct RotateJob
+{
+    size_t src;
+    size_t dst;
+    int angle;
+};
+
+// Same rotation as RotateImage, but the remap tables are built once for
+// each image size and integer angle and then shared by all the threads
+class RotateAugmenter
+{
+public:
+    static RotateAugmenter& Default();
+
+    void Rotate(const Mat &image, int angle, Mat *result);
+    // Run the jobs in parallel. The results of the same size and type
+    // share one preallocated block, and no source can be a destination.
+    void RotateBatch(vector<Mat> *images, const vector<RotateJob> &jobs);
+
+private:
+    typedef std::tuple<int, int, int> MapKey;  // rows, cols and angle
+
+    std::mutex mutex_;
+    map<MapKey, std::pair<Mat, Mat>> maps_;
+
+    void GetMaps(Size size, int angle, Mat *map1, Mat *map2);
+};
+}  // namespace ghk
+
+#endif  // FINAL_ROTATE_AUGMENTER_H_
@@ -6,9 +6,13 @@
  ************************************************************************/
 #include "test_class_util.h"
 #include "file_util.h"
+#include "hog_extractor.h"
 #include "mat_util.h"
+#include "math_util.h"
+#include "rotate_augmenter.h"
 #include "sign_detector.h"
 #include "test_util.h"
+#include "timer.h"
 
 namespace ghk
 {
@@ -107,6 +111,7 @@ void TestDataset(Dataset &dataset)
     vector<int> labels;
     
     dataset.GetFullImage(idx, &test_image);
+    test_image = test_image.clone();  // may be a header over the pack
     dataset.GetDetectLabels(idx, &labels);
     dataset.GetDetectRects(idx, &rects);
 
@@ -190,4 +195,200 @@ void TestDetectorFunc()
         cout << rects[i] << " " << labels[i] << " " << probs[i] << endl;
     }
 }
+
+// Clusters of jittered boxes like the raw hits of the sliding window
+void GenerateRandomRects(int rect_num, Size frame_size, vector<Rect> *rects,
+        vector<int> *labels, vector<float> *probs)
+{
+    const int cluster_size = 20;
+    rects->clear();
+    labels->clear();
+    probs->clear();
+    while (static_cast<int>(rects->size()) < rect_num)
+    {
+        int size = SIZE_LIST[Random(SIZE_LIST.size())];
+        int label = Random(CLASS_NUM - 1) + 1;
+        int x = Random(max(1, frame_size.width - size));
+        int y = Random(max(1, frame_size.height - size));
+        for (int i = 0; i < cluster_size
+                && static_cast<int>(rects->size()) < rect_num; ++i)
+        {
+            int side = size + size * (Random(21) - 10) / 100;
+            rects->push_back(Rect(x + (Random(5) - 2) * DETECT_STEP / 2,
+                        y + (Random(5) - 2) * DETECT_STEP / 2, side, side));
+            labels->push_back(label);
+            probs->push_back(Random(1000) / 1000.0f);
+        }
+    }
+}
+
+bool RectLess(const Rect &lhs, const Rect &rhs)
+{
+    if (lhs.x != rhs.x) return lhs.x < rhs.x;
+    if (lhs.y != rhs.y) return lhs.y < rhs.y;
+    if (lhs.width != rhs.width) return lhs.width < rhs.width;
+    return lhs.height < rhs.height;
+}
+
+// Results of merging in a canonical order for comparison
+void SortMergedRects(vector<Rect> &rects, vector<int> &labels,
+        vector<float> &probs)
+{
+    vector<size_t> idx(rects.size());
+    for (size_t i = 0; i < idx.size(); ++i)
+    {
+        idx[i] = i;
+    }
+    std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+        if (labels[a] != labels[b]) return labels[a] < labels[b];
+        if (!(rects[a] == rects[b])) return RectLess(rects[a], rects[b]);
+        return probs[a] < probs[b];
+    });
+    vector<Rect> rrects;
+    vector<int> rlabels;
+    vector<float> rprobs;
+    for (auto i: idx)
+    {
+        rrects.push_back(rects[i]);
+        rlabels.push_back(labels[i]);
+        rprobs.push_back(probs[i]);
+    }
+    rects.swap(rrects);
+    labels.swap(rlabels);
+    probs.swap(rprobs);
+}
+
+void TestMergeRectsSpeed()
+{
+    const int brute_force_max = 20000;  // all-pairs is too slow beyond
+    const vector<int> rect_nums{1000, 3000, 10000, 30000, 100000};
+    Timer timer;
+    for (auto rect_num: rect_nums)
+    {
+        vector<Rect> rects;
+        vector<int> labels;
+        vector<float> probs;
+        GenerateRandomRects(rect_num, Size(1280, 720), &rects, &labels,
+                &probs);
+
+        vector<Rect> grid_rects(rects);
+        vector<int> grid_labels(labels);
+        vector<float> grid_probs(probs);
+        timer.Start();
+        MergeRects(grid_rects, grid_labels, grid_probs, 0.667f);
+        float grid_time = timer.Snapshot();
+
+        vector<Rect> nms_rects(rects);
+        vector<int> nms_labels(labels);
+        vector<float> nms_probs(probs);
+        timer.Start();
+        SuppressRects(nms_rects, nms_labels, nms_probs, 0.5f);
+        float nms_time = timer.Snapshot();
+
+        printf("%d boxes: grid merge %0.4fs (%zu boxes), "
+                "greedy NMS %0.4fs (%zu boxes)", rect_num, grid_time,
+                grid_rects.size(), nms_time, nms_rects.size());
+        if (rect_num > brute_force_max)
+        {
+            printf("\n");
+            continue;
+        }
+
+        timer.Start();
+        MergeRectsBruteForce(rects, labels, probs, 0.667f);
+        float brute_time = timer.Snapshot();
+        SortMergedRects(rects, labels, probs);
+        SortMergedRects(grid_rects, grid_labels, grid_probs);
+        bool is_same = rects.size() == grid_rects.size();
+        for (size_t i = 0; is_same && i < rects.size(); ++i)
+        {
+            is_same = rects[i] == grid_rects[i]
+                && labels[i] == grid_labels[i] && probs[i] == grid_probs[i];
+        }
+        printf(", brute force %0.4fs, %s\n", brute_time,
+                is_same ? "same" : "DIFFERENT");
+    }
+}
+
+void TestRotateAugmenterSpeed()
+{
+    const int image_num = 10000;
+    const int image_size = 50;
+    vector<Mat> images;
+    vector<RotateJob> jobs;
+    for (int i = 0; i < image_num; ++i)
+    {
+        Mat image(image_size, image_size, CV_8U);
+        cv::randu(image, 0, 256);
+        images.push_back(image);
+        size_t src = images.size() - 1;
+        for (int j = 0; j < AUGMENT_TIMES; ++j)
+        {
+            jobs.push_back(RotateJob{src, images.size(),
+                    Random(AUGMENT_ROTATE * 2 + 1) - AUGMENT_ROTATE});
+            images.push_back(Mat());
+        }
+    }
+
+    Timer timer;
+    vector<Mat> rot_images(images.size());
+    timer.Start();
+    for (auto &job: jobs)
+    {
+        rot_images[job.dst] = images[job.src].clone();
+        RotateImage(rot_images[job.dst], job.angle);
+    }
+    float warp_time = timer.Snapshot();
+
+    timer.Start();
+    RotateAugmenter::Default().RotateBatch(&images, jobs);
+    float batch_time = timer.Snapshot();
+
+    double max_diff = 0;
+    for (auto &job: jobs)
+    {
+        max_diff = std::max(max_diff, cv::norm(images[job.dst],
+                    rot_images[job.dst], cv::NORM_INF));
+    }
+    printf("%zu rotations: warpAffine %0.4fs, cached batch %0.4fs, "
+            "max difference %0.0f\n", jobs.size(), warp_time, batch_time,
+            max_diff);
+}
+
+void TestHogKernelSpeed(int num_orient, int cell_size, int image_size)
+{
+    const int image_num = 10000;
+    vector<Mat> images;
+    for (int i = 0; i < image_num; ++i)
+    {
+        Mat image(image_size, image_size, CV_8U);
+        cv::randu(image, 0, 256);
+        images.push_back(image);
+    }
+
+    HogExtractor extractor(num_orient, cell_size);
+    Timer timer;
+    Mat vl_feats;
+    extractor.set_use_native(false);
+    timer.Start();
+    extractor.ExtractBatch(images, &vl_feats);
+    float vl_time = timer.Snapshot();
+
+    Mat native_feats;
+    extractor.set_use_native(true);
+    if (HogKernel::Get(num_orient, cell_size) == nullptr)
+    {
+        printf("No native HOG kernel for (%d, %d).\n", num_orient,
+                cell_size);
+        return;
+    }
+    timer.Start();
+    extractor.ExtractBatch(images, &native_feats);
+    float native_time = timer.Snapshot();
+
+    printf("HOG (%d, %d) on %d %dx%d images: vlfeat %0.4fs, "
+            "native %0.4fs, max difference %g\n", num_orient, cell_size,
+            image_num, image_size, image_size, vl_time, native_time,
+            cv::norm(vl_feats, native_feats, cv::NORM_INF));
+}
 }  // namespace ghk
@@ -17,6 +17,12 @@ void Generate2dRandomData(int train_cnt, int test_cnt, Mat *data);
 void TestClassifier(Classifier *classifier, const string &tmp_dir);
 void TestDataset(Dataset &dataset);
 void TestDetectorFunc();
+// Benchmark MergeRects against the brute force version and greedy NMS
+void TestMergeRectsSpeed();
+// Benchmark the cached rotation against RotateImage on random patches
+void TestRotateAugmenterSpeed();
+// Benchmark the native HOG kernel against vlfeat on random patches
+void TestHogKernelSpeed(int num_orient, int cell_size, int image_size);
 }  // namespace ghk
 
 #endif  // FINAL_TEST_CLASS_UTIL_
@@ -156,4 +156,95 @@ float UpdateThreshold(const vector<bool> &results, const vector<float> &scores,
     }
     return accuracy;
 }
+
+float MatchDetection(const vector<vector<Rect>> &rects_truth,
+        const vector<vector<int>> &labels_truth,
+        const vector<vector<Rect>> &rects, const vector<vector<int>> &labels,
+        const vector<vector<float>> &probs, vector<bool> *results,
+        vector<float> *scores, float overlap)
+{
+    results->clear();
+    scores->clear();
+    size_t pos_num = 0;
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        pos_num += rects_truth[i].size();
+
+        // Each detection takes the best unmatched ground truth
+        vector<size_t> idx(rects[i].size());
+        for (size_t j = 0; j < idx.size(); ++j)
+        {
+            idx[j] = j;
+        }
+        std::stable_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+            return probs[i][a] > probs[i][b];
+        });
+        vector<bool> is_matched(rects_truth[i].size(), false);
+        for (auto j: idx)
+        {
+            int best = -1;
+            float best_rate = overlap;
+            for (size_t k = 0; k < rects_truth[i].size(); ++k)
+            {
+                if (is_matched[k] || labels_truth[i][k] != labels[i][j])
+                {
+                    continue;
+                }
+                float rate = static_cast<float>(
+                        (rects_truth[i][k] & rects[i][j]).area())
+                    / ((rects_truth[i][k] | rects[i][j]).area());
+                if (rate >= best_rate)
+                {
+                    best_rate = rate;
+                    best = static_cast<int>(k);
+                }
+            }
+            if (best >= 0)
+            {
+                is_matched[best] = true;
+            }
+            results->push_back(best >= 0);
+            scores->push_back(probs[i][j]);
+        }
+    }
+    if (results->empty() || pos_num == 0)
+    {
+        return 0.0f;
+    }
+
+    // Precision at each recall from high scores to low
+    vector<Result> res_vec;
+    for (size_t i = 0; i < results->size(); ++i)
+    {
+        res_vec.push_back(Result{(*results)[i], (*scores)[i]});
+    }
+    sort(res_vec.rbegin(), res_vec.rend(), ResultComp);
+    size_t n = res_vec.size();
+    vector<float> precisions(n);
+    vector<float> recalls(n);
+    float tp = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (res_vec[i].res)
+        {
+            ++tp;
+        }
+        precisions[i] = tp / (i + 1);
+        recalls[i] = tp / pos_num;
+    }
+
+    // Area under the interpolated precision-recall curve
+    for (size_t i = n - 1; i > 0; --i)
+    {
+        precisions[i - 1] = max(precisions[i - 1], precisions[i]);
+    }
+    float ap = 0;
+    float last_recall = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        ap += (recalls[i] - last_recall) * precisions[i];
+        last_recall = recalls[i];
+    }
+    return ap;
+}
 }  // namespace ghk
@@ -19,5 +19,13 @@ void EvaluateClassify(const vector<int> &ground_truth,
 float UpdateThreshold(const vector<bool> &results, const vector<float> &scores,
         const string &file_name, int pos_num, int win_num,
         float *th, float fppw = 1e-4);
+// Match detections to the ground truth once, greedily in the descending
+// order of scores as PASCAL VOC, and return the average precision.
+// The results and scores can be passed to UpdateThreshold for the curve.
+float MatchDetection(const vector<vector<Rect>> &rects_truth,
+        const vector<vector<int>> &labels_truth,
+        const vector<vector<Rect>> &rects, const vector<vector<int>> &labels,
+        const vector<vector<float>> &probs, vector<bool> *results,
+        vector<float> *scores, float overlap = 0.5f);
 }  // namespace ghk
 #endif  // FINAL_TEST_UTIL_H_
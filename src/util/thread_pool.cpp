@@ -0,0 +1,160 @@
+/*************************************************************************
+    > File Name: src/util/thread_pool.cpp
+    > Author: Guo Hengkai
+    > Description: Work-stealing thread pool class implementation
+    > Created Time: Mon 06 Jul 2015 02:40:12 PM CST
+ ************************************************************************/
+#include "thread_pool.h"
+
+namespace ghk
+{
+// Whether the current thread is running a task of any pool
+thread_local bool in_pool_task = false;
+
+ThreadPool::ThreadPool(int thread_num):
+    thread_num_(thread_num), task_(nullptr), remaining_(0),
+    generation_(0), stop_(false)
+{
+    if (thread_num_ <= 0)
+    {
+        thread_num_ = max(1, static_cast<int>(
+                    std::thread::hardware_concurrency()));
+    }
+
+    // The calling thread works as thread 0
+    queues_ = vector<TaskQueue>(thread_num_);
+    for (int i = 1; i < thread_num_; ++i)
+    {
+        workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cond_.notify_all();
+    for (auto &worker: workers_)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::Default()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::ParallelFor(size_t n,
+        const std::function<void(size_t, int)> &task)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    if (thread_num_ == 1 || n == 1 || in_pool_task)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            task(i, 0);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    task_ = &task;
+    remaining_ = n;
+
+    // Give each thread a contiguous block of indices
+    for (int t = 0; t < thread_num_; ++t)
+    {
+        size_t begin = n * t / thread_num_;
+        size_t end = n * (t + 1) / thread_num_;
+        std::lock_guard<std::mutex> lock(queues_[t].mutex);
+        for (size_t i = begin; i < end; ++i)
+        {
+            queues_[t].tasks.push_back(i);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    start_cond_.notify_all();
+
+    in_pool_task = true;
+    RunTasks(0);
+    in_pool_task = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this] { return remaining_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int thread_id)
+{
+    in_pool_task = true;
+    size_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cond_.wait(lock, [&] {
+                return stop_ || generation_ != generation;
+            });
+            if (stop_)
+            {
+                return;
+            }
+            generation = generation_;
+        }
+        RunTasks(thread_id);
+    }
+}
+
+void ThreadPool::RunTasks(int thread_id)
+{
+    size_t idx;
+    while (PopTask(thread_id, &idx))
+    {
+        (*task_)(idx, thread_id);
+        if (--remaining_ == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_cond_.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::PopTask(int thread_id, size_t *idx)
+{
+    // Own queue from the front
+    {
+        TaskQueue &queue = queues_[thread_id];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            *idx = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back of the others
+    for (int i = 1; i < thread_num_; ++i)
+    {
+        TaskQueue &queue = queues_[(thread_id + i) % thread_num_];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            *idx = queue.tasks.back();
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace ghk
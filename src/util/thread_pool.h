@@ -0,0 +1,65 @@
+/*************************************************************************
+    > File Name: src/util/thread_pool.h
+    > Author: Guo Hengkai
+    > Description: Work-stealing thread pool class definition
+    > Created Time: Mon 06 Jul 2015 02:13:45 PM CST
+ ************************************************************************/
+#ifndef FINAL_THREAD_POOL_H_
+#define FINAL_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "common.h"
+
+namespace ghk
+{
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int thread_num = 0);  // 0 for all the cores
+    ~ThreadPool();
+
+    // Run task(idx, thread_id) for idx in [0, n) and wait for all of them.
+    // Each thread starts from its own block of indices and steals from
+    // the others when it runs out. Calls from inside a task run serially.
+    void ParallelFor(size_t n, const std::function<void(size_t, int)> &task);
+
+    inline int thread_num() const { return thread_num_; }
+
+    // Shared pool using all the cores
+    static ThreadPool& Default();
+
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    int thread_num_;
+    vector<std::thread> workers_;
+    vector<TaskQueue> queues_;
+    const std::function<void(size_t, int)> *task_;
+    std::atomic<size_t> remaining_;
+
+    std::mutex mutex_;
+    std::mutex run_mutex_;
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+    size_t generation_;
+    bool stop_;
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void WorkerLoop(int thread_id);
+    void RunTasks(int thread_id);
+    bool PopTask(int thread_id, size_t *idx);
+};
+}  // namespace ghk
+
+#endif  // FINAL_THREAD_POOL_H_